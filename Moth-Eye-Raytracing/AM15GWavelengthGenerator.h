@@ -1,46 +1,22 @@
 #pragma once
 #include "WavelengthGenerator.h"
-#include <fstream>
-#include <nlohmann/json.hpp>
-#include <iostream>
-#include <random>
-using json = nlohmann::json;
+#include "DistributionRegistry.h"
 class AM15GWavelengthGenerator : public WavelengthGenerator
 {
 public:
 
-	std::vector<double> Wavelengths;
+	// Loaded once and shared by every AM15G generator, so constructing one costs a registry lookup
+	TabulatedDistribution* Spectrum;
 
-	std::discrete_distribution<int> Distribution;
-
-	std::mt19937 Generator;
-
-	AM15GWavelengthGenerator() : Generator(std::random_device{}())
-	{
-		LoadDistribution();
-	}
-
-	void LoadDistribution()
+	AM15GWavelengthGenerator() : Spectrum(DistributionRegistry::Get("AM15_spectrum.json", "Wavelength"))
 	{
-		std::ifstream file("AM15_spectrum.json");
-		if (!file.is_open()) {
-			std::cerr << "Error: could not open JSON file\n";
-			return;
-		}
-
-		json AMDist;
-
-		file >> AMDist;
-
-		std::vector<double> probability = AMDist["Probability"].get<std::vector<double>>();
-
-		Wavelengths = AMDist["Wavelength"].get<std::vector<double>>();
-		Distribution = std::discrete_distribution<int>(probability.begin(), probability.end());
 	}
 
 	double GenerateWavelength() override
 	{
-		int index = Distribution(Generator);
-		return Wavelengths[index];
+		if (Spectrum == nullptr)
+			return WavelengthGenerator::GenerateWavelength();
+
+		return Spectrum->Sample();
 	}
 };
\ No newline at end of file
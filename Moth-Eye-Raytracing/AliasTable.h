@@ -0,0 +1,97 @@
+#pragma once
+#include <vector>
+// Walker / Vose alias table, samples a discrete distribution in O(1) from a single uniform
+class AliasTable
+{
+public:
+
+	// Chance of keeping bin i rather than taking Alias[i]
+	std::vector<double> Probability;
+
+	std::vector<int> Alias;
+
+	AliasTable()
+	{
+	}
+
+	AliasTable(const std::vector<double>& weights)
+	{
+		Build(weights);
+	}
+
+	void Build(const std::vector<double>& weights)
+	{
+		int count = weights.size();
+
+		Probability = std::vector<double>(count, 1.0);
+		Alias = std::vector<int>(count, 0);
+
+		double total = 0.0;
+
+		for (double weight : weights)
+			total += weight;
+
+		if (count == 0 || total <= 0.0)
+			return;
+
+		std::vector<double> scaled = std::vector<double>(count);
+		std::vector<int> small;
+		std::vector<int> large;
+
+		for (int i = 0; i < count; i++)
+		{
+			scaled[i] = weights[i] * count / total;
+			Alias[i] = i;
+
+			if (scaled[i] < 1.0)
+				small.push_back(i);
+			else
+				large.push_back(i);
+		}
+
+		// Each under-full bin is topped up by one over-full bin, which then goes back on a list with what it has left
+		while (!small.empty() && !large.empty())
+		{
+			int less = small.back();
+			small.pop_back();
+
+			int more = large.back();
+
+			Probability[less] = scaled[less];
+			Alias[less] = more;
+
+			scaled[more] -= 1.0 - scaled[less];
+
+			if (scaled[more] < 1.0)
+			{
+				large.pop_back();
+				small.push_back(more);
+			}
+		}
+
+		// Whatever is left is full up to rounding
+		for (int i : small)
+			Probability[i] = 1.0;
+
+		for (int i : large)
+			Probability[i] = 1.0;
+	}
+
+	// u in [0, 1), the integer part picks the bin and the fraction decides between it and its alias
+	int Sample(double u)
+	{
+		int count = Probability.size();
+		double x = u * count;
+		int bin = (int)x;
+
+		if (bin >= count)
+			bin = count - 1;
+
+		return (x - bin) < Probability[bin] ? bin : Alias[bin];
+	}
+
+	bool Empty()
+	{
+		return Probability.empty();
+	}
+};
@@ -0,0 +1,376 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+#include <iostream>
+#include "Object.h"
+#include "QuantumDot.h"
+#include "NE451Sims.h"
+#include "AM15GWavelengthGenerator.h"
+
+// Replacing the global operator new affects the whole program, so the allocation counter is only compiled in when
+// COUNT_ALLOCATIONS is defined before this header is included
+#ifdef COUNT_ALLOCATIONS
+std::atomic<long long> AllocationCount(0);
+
+void* operator new(size_t size)
+{
+	AllocationCount++;
+
+	void* memory = std::malloc(size == 0 ? 1 : size);
+
+	if (memory == nullptr)
+		throw std::bad_alloc();
+
+	return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+#endif
+
+struct BenchmarkResult
+{
+	double BuildTimeMS = 0.0;
+	double TraversalTimeMS = 0.0;
+	double BruteForceTimeMS = 0.0;
+	int Hits = 0;
+	int Mismatches = 0;
+	double NodeVisits = 0.0;
+	double UnorderedNodeVisits = 0.0;
+};
+
+RayHit BruteForceIntersect(Object* object, Ray* ray)
+{
+	double minT = INFINITY;
+	int closestSegment = -1;
+
+	for (int i = 0; i < object->Segments.Size(); i++)
+	{
+		RayHit hit = object->Segments.Intersect(i, ray);
+
+		if (hit.Hit && hit.Distance < minT)
+		{
+			minT = hit.Distance;
+			closestSegment = i;
+		}
+	}
+
+	if (closestSegment < 0)
+		return RayHit(false, 0.0, -1);
+
+	return RayHit(true, minT, closestSegment);
+}
+
+// Nodes an unordered traversal enters, it recurses into both children and never prunes
+int CountUnorderedVisits(Object* object, int nodeIndex, Ray* ray)
+{
+	ObjectNode& node = object->Nodes[nodeIndex];
+
+	if (!node.Bounds.Intersects(ray))
+		return 0;
+
+	if (node.IsLeaf())
+		return 1;
+
+	return 1 + CountUnorderedVisits(object, nodeIndex + 1, ray) + CountUnorderedVisits(object, node.Start, ray);
+}
+
+// Times are the best of all repeats to keep the numbers stable on a busy machine
+BenchmarkResult BenchmarkObject(Object* object, std::vector<Ray>& rays, int repeats)
+{
+	BenchmarkResult result;
+	result.BuildTimeMS = INFINITY;
+	result.TraversalTimeMS = INFINITY;
+	result.BruteForceTimeMS = INFINITY;
+
+	for (int r = 0; r < repeats; r++)
+	{
+		auto startBuild = std::chrono::high_resolution_clock::now();
+		object->BVH();
+		auto endBuild = std::chrono::high_resolution_clock::now();
+
+		result.BuildTimeMS = std::min(result.BuildTimeMS, std::chrono::duration<double, std::milli>(endBuild - startBuild).count());
+	}
+
+	std::vector<RayHit> hits = std::vector<RayHit>(rays.size(), RayHit(false, 0.0, -1));
+	std::vector<RayHit> references = std::vector<RayHit>(rays.size(), RayHit(false, 0.0, -1));
+
+	for (int r = 0; r < repeats; r++)
+	{
+		auto startTraversal = std::chrono::high_resolution_clock::now();
+
+		for (int i = 0; i < rays.size(); i++)
+			hits[i] = object->Intersect(&rays[i]);
+
+		auto endTraversal = std::chrono::high_resolution_clock::now();
+
+		result.TraversalTimeMS = std::min(result.TraversalTimeMS, std::chrono::duration<double, std::milli>(endTraversal - startTraversal).count());
+
+		auto startBrute = std::chrono::high_resolution_clock::now();
+
+		for (int i = 0; i < rays.size(); i++)
+			references[i] = BruteForceIntersect(object, &rays[i]);
+
+		auto endBrute = std::chrono::high_resolution_clock::now();
+
+		result.BruteForceTimeMS = std::min(result.BruteForceTimeMS, std::chrono::duration<double, std::milli>(endBrute - startBrute).count());
+	}
+
+	for (int i = 0; i < rays.size(); i++)
+	{
+		int visits = 0;
+		object->Intersect(&rays[i], &visits);
+
+		result.NodeVisits += (double)visits / rays.size();
+		result.UnorderedNodeVisits += (double)CountUnorderedVisits(object, 0, &rays[i]) / rays.size();
+
+		if (hits[i].Hit)
+			result.Hits++;
+
+		if (references[i].Hit != hits[i].Hit || (references[i].Hit && std::abs(references[i].Distance - hits[i].Distance) > 1e-9))
+			result.Mismatches++;
+	}
+
+	return result;
+}
+
+// Objects that solve their hits analytically have no segments to brute force, only the timings are measured
+BenchmarkResult BenchmarkAnalytic(Object* object, std::vector<Ray>& rays, int repeats)
+{
+	BenchmarkResult result;
+	result.BuildTimeMS = INFINITY;
+	result.TraversalTimeMS = INFINITY;
+
+	for (int r = 0; r < repeats; r++)
+	{
+		auto startBuild = std::chrono::high_resolution_clock::now();
+		object->BVH();
+		auto endBuild = std::chrono::high_resolution_clock::now();
+
+		result.BuildTimeMS = std::min(result.BuildTimeMS, std::chrono::duration<double, std::milli>(endBuild - startBuild).count());
+
+		int hits = 0;
+
+		auto startTraversal = std::chrono::high_resolution_clock::now();
+
+		for (int i = 0; i < rays.size(); i++)
+			if (object->Intersect(&rays[i]).Hit)
+				hits++;
+
+		auto endTraversal = std::chrono::high_resolution_clock::now();
+
+		result.TraversalTimeMS = std::min(result.TraversalTimeMS, std::chrono::duration<double, std::milli>(endTraversal - startTraversal).count());
+		result.Hits = hits;
+	}
+
+	return result;
+}
+
+void PrintBenchmark(std::string name, BenchmarkResult result, int queries)
+{
+	std::cout << name << " : Build " << result.BuildTimeMS << " ms, "
+		<< "BVH " << 1e6 * result.TraversalTimeMS / queries << " ns/ray, "
+		<< "Brute Force " << 1e6 * result.BruteForceTimeMS / queries << " ns/ray, "
+		<< "Nodes Visited " << result.NodeVisits << " (Unordered " << result.UnorderedNodeVisits << "), "
+		<< "Hits " << result.Hits << ", Mismatches " << result.Mismatches << std::endl;
+}
+
+void PrintAnalyticBenchmark(std::string name, BenchmarkResult result, int queries)
+{
+	std::cout << name << " : Build " << result.BuildTimeMS << " ms, "
+		<< "Intersect " << 1e6 * result.TraversalTimeMS / queries << " ns/ray, "
+		<< "Hits " << result.Hits << std::endl;
+}
+
+void RunBVHBenchmark(int numOfRays = 20000, int repeats = 10)
+{
+	double pi = 3.14159265358979323846;
+
+	std::mt19937 generator(451);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+	ConstantPerturbance perturbance = ConstantPerturbance(0);
+
+	// Wavy moth eye layer as used in RunWavyNormalPerturbance, and the same segments behind a generic Object BVH
+	Object* wave = CreateWave(-500.0, 100.0, 500.0, 100.0, 500, [](double) { return 1.2; }, &perturbance, 1.0, 2.0 * pi / 1200.0, 0.0, 0.0);
+
+	Object* waveSegments = new Object();
+	waveSegments->Segments = wave->Segments;
+	waveSegments->Materials = wave->Materials;
+
+	std::vector<Ray> waveRays;
+
+	for (int i = 0; i < numOfRays; i++)
+	{
+		double angle = (unit(generator) - 0.5) * 0.9 * pi;
+		waveRays.push_back(Ray(-500.0 + 1000.0 * unit(generator), 300.0, std::sin(angle), -std::cos(angle)));
+	}
+
+	// Quantum dot as used in RealLifeTestUnitCell, and the 250 segment polygon it used to be tessellated into
+	QuantumDot* dot = new QuantumDot(0.0, -100.0, 5.0, 250);
+
+	Object* polygon = new Object();
+	std::vector<double> theta = polygon->linspace(0.0, 2.0 * pi, 250);
+
+	int material = polygon->AddMaterial([](double) { return 1.0; }, &perturbance);
+
+	for (int i = 0; i < theta.size(); i++)
+		polygon->AddSegment(5.0 * std::cos(theta[i]), -100.0 + 5.0 * std::sin(theta[i]), 5.0 * std::cos(theta[(i + 1) % theta.size()]), -100.0 + 5.0 * std::sin(theta[(i + 1) % theta.size()]), material);
+
+	std::vector<Ray> dotRays;
+
+	for (int i = 0; i < numOfRays; i++)
+	{
+		double angle = 2.0 * pi * unit(generator);
+		Vec2 origin = Vec2(20.0 * std::cos(angle), -100.0 + 20.0 * std::sin(angle));
+		Vec2 aim = Vec2(12.0 * (unit(generator) - 0.5), -100.0 + 12.0 * (unit(generator) - 0.5));
+		Vec2 direction = aim - origin;
+
+		dotRays.push_back(Ray(origin.X, origin.Y, direction.X, direction.Y));
+	}
+
+	PrintBenchmark("Wave BVH (500 Segments)", BenchmarkObject(waveSegments, waveRays, repeats), numOfRays);
+	PrintBenchmark("Wave Height Field (500 Segments)", BenchmarkObject(wave, waveRays, repeats), numOfRays);
+	PrintBenchmark("QuantumDot Polygon (250 Segments)", BenchmarkObject(polygon, dotRays, repeats), numOfRays);
+	PrintAnalyticBenchmark("QuantumDot (Analytic Circle)", BenchmarkAnalytic(dot, dotRays, repeats), numOfRays);
+
+	delete wave;
+	delete waveSegments;
+	delete dot;
+	delete polygon;
+}
+
+// AM15G generator construction and draws, the alias table against std::discrete_distribution on the same table
+void RunSpectrumBenchmark(int numOfDraws = 1000000, int numOfGenerators = 10000)
+{
+	std::ifstream file("AM15_spectrum.json");
+	json spectrum;
+	file >> spectrum;
+
+	std::vector<double> wavelengths = spectrum["Wavelength"].get<std::vector<double>>();
+	std::vector<double> probability = spectrum["Probability"].get<std::vector<double>>();
+
+	double total = 0.0;
+	double expectedMean = 0.0;
+
+	for (int i = 0; i < probability.size(); i++)
+	{
+		total += probability[i];
+		expectedMean += probability[i] * wavelengths[i];
+	}
+
+	expectedMean /= total;
+
+	auto startParse = std::chrono::high_resolution_clock::now();
+
+	std::discrete_distribution<int> distribution(probability.begin(), probability.end());
+
+	auto endParse = std::chrono::high_resolution_clock::now();
+
+	// First construction loads the registry, the rest only look it up
+	AM15GWavelengthGenerator first = AM15GWavelengthGenerator();
+
+	auto startConstruct = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < numOfGenerators; i++)
+	{
+		AM15GWavelengthGenerator generator = AM15GWavelengthGenerator();
+		first.Spectrum = generator.Spectrum;
+	}
+
+	auto endConstruct = std::chrono::high_resolution_clock::now();
+
+	std::mt19937 engine(451);
+	double discreteMean = 0.0;
+
+	auto startDiscrete = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < numOfDraws; i++)
+		discreteMean += wavelengths[distribution(engine)];
+
+	auto endDiscrete = std::chrono::high_resolution_clock::now();
+
+	RandomStream::Current().Begin(451, 0, 0);
+	double aliasMean = 0.0;
+
+	auto startAlias = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < numOfDraws; i++)
+		aliasMean += first.GenerateWavelength();
+
+	auto endAlias = std::chrono::high_resolution_clock::now();
+
+	std::cout << "AM15G Generator : Construction " << 1e6 * std::chrono::duration<double, std::milli>(endConstruct - startConstruct).count() / numOfGenerators << " ns"
+		<< " (discrete_distribution alone " << std::chrono::duration<double, std::milli>(endParse - startParse).count() << " ms)" << std::endl;
+	std::cout << "discrete_distribution : " << 1e6 * std::chrono::duration<double, std::milli>(endDiscrete - startDiscrete).count() / numOfDraws << " ns/draw, Mean " << discreteMean / numOfDraws << " nm" << std::endl;
+	std::cout << "Alias Table : " << 1e6 * std::chrono::duration<double, std::milli>(endAlias - startAlias).count() / numOfDraws << " ns/draw, Mean " << aliasMean / numOfDraws << " nm (Expected " << expectedMean << " nm)" << std::endl;
+}
+
+// Only compiled with the allocation counter, to run it define COUNT_ALLOCATIONS above the includes in kernel.cu and
+// return RunAllocationBenchmark() from main
+#ifdef COUNT_ALLOCATIONS
+// Allocations made by one Bake of the moth eye block cut off after the given number of generations
+long long CountBakeAllocations(BakeOrder order, int generations, int threadCount, int numOfRays, bool nextEventEstimation)
+{
+	Scene scene = CreateUnitCellWaveguideBlock("Allocations", 100, new ConstantPerturbance(0));
+	scene.AddObject(new Mirror(-125.0, 500.0, -125.0, 0));
+	scene.AddObject(new Mirror(125.0, 500.0, 125.0, 0));
+	scene.AddRaySource(new DirectionalLight(-125.0 * 0.95, 300.0, 125.0 * 0.95, 300.0, numOfRays, new AM15GWavelengthGenerator(), new ConstantPerturbance(0)));
+
+	scene.Order = order;
+	scene.MaxGenerations = generations;
+	scene.MinInFlightFraction = 0.0;
+	scene.NextEventEstimation = nextEventEstimation;
+
+	scene.Initialize(false, threadCount);
+
+	long long before = AllocationCount;
+	scene.Bake<StatsOnlyRecording>(false, threadCount);
+
+	return AllocationCount - before;
+}
+
+// A steady-state bake doesn't allocate : once the ray buffers have grown to the size of a generation, further generations
+// must not add any allocations, so a bake cut off later allocates exactly as much as one cut off earlier
+// Returns the number of cases that allocate in steady state, so main can return it as the exit code
+int RunAllocationBenchmark(int numOfRays = 2000)
+{
+	struct AllocationCase
+	{
+		std::string Name;
+		BakeOrder Order;
+		int ThreadCount;
+		bool NextEventEstimation;
+	};
+
+	std::vector<AllocationCase> cases = {
+		{ "Breadth-First", BakeOrder::BreadthFirst, 1, false },
+		{ "Breadth-First, 4 Threads", BakeOrder::BreadthFirst, 4, false },
+		{ "Breadth-First, Next-Event", BakeOrder::BreadthFirst, 1, true },
+		{ "Depth-First", BakeOrder::DepthFirst, 1, false },
+		{ "Depth-First, 4 Threads", BakeOrder::DepthFirst, 4, false },
+	};
+
+	int failures = 0;
+
+	for (AllocationCase& allocationCase : cases)
+	{
+		long long warmUp = CountBakeAllocations(allocationCase.Order, 10, allocationCase.ThreadCount, numOfRays, allocationCase.NextEventEstimation);
+		long long steady = CountBakeAllocations(allocationCase.Order, 80, allocationCase.ThreadCount, numOfRays, allocationCase.NextEventEstimation);
+
+		std::cout << allocationCase.Name << " : " << warmUp << " Allocations over 10 Generations, " << steady << " over 80 Generations"
+			<< (steady == warmUp ? " (Steady State Allocation Free)" : " (ALLOCATES IN STEADY STATE)") << std::endl;
+
+		if (steady != warmUp)
+			failures++;
+	}
+
+	return failures;
+}
+#endif
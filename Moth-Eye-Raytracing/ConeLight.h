@@ -14,17 +14,17 @@ public:
 	{
 	}
 
-	std::vector<Ray> GenerateRays() override
+	std::vector<Ray> GenerateRays(std::vector<SpectralBundle>& bundles) override
 	{
 		std::vector<Ray> rays = std::vector<Ray>();
 
 		Vec2 AB = B - A;
 		bool degenerate = (std::abs(AB.X) < 1e-12 && std::abs(AB.Y) < 1e-12);
 
-		WavelengthGenerator& wg = *this->WavelengthGen;
-
 		for (int i = 0; i < NumberOfRays; ++i)
 		{
+			RandomStream::Current().Select(i);
+
 			double t = (double)i / (double)(NumberOfRays - 1);
 
 			Vec2 target = Vec2(0, 0);
@@ -37,8 +37,9 @@ public:
 			Vec2 dir = target - Origin;
 			dir.Normalize();
 
-			Ray ray = Ray(Origin.X, Origin.Y, dir.X, dir.Y, wg.GenerateWavelength());
+			Ray ray = Ray(Origin.X, Origin.Y, dir.X, dir.Y);
 			ray.CurrentMedium = this->CurrentMedium;
+			this->AssignWavelengths(ray, bundles);
 
 			rays.push_back(ray);
 		}
@@ -0,0 +1,80 @@
+#pragma once
+#include <map>
+#include <string>
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+// Power accounting for the rays of one configuration
+struct ConfigurationTally
+{
+public:
+	int StartRays = 0;
+	double StartPower = 0.0;
+
+	int CapturedRays = 0;
+	double CapturedPower = 0.0;
+
+	int LostRays = 0;
+	double LostPower = 0.0;
+
+	int DestroyedRays = 0;
+	double DestroyedPower = 0.0;
+
+	int RouletteRays = 0;
+
+	int InFlightRays = 0;
+	double InFlightPower = 0.0;
+
+	void Merge(ConfigurationTally& other)
+	{
+		StartRays += other.StartRays;
+		StartPower += other.StartPower;
+		CapturedRays += other.CapturedRays;
+		CapturedPower += other.CapturedPower;
+		LostRays += other.LostRays;
+		LostPower += other.LostPower;
+		DestroyedRays += other.DestroyedRays;
+		DestroyedPower += other.DestroyedPower;
+		RouletteRays += other.RouletteRays;
+		InFlightRays += other.InFlightRays;
+		InFlightPower += other.InFlightPower;
+	}
+};
+
+// One row of a multi-configuration bake, e.g. a source angle, wavelength and repeat index sharing the scene's geometry
+struct Configuration
+{
+public:
+	std::string Name;
+
+	std::map<std::string, double> Parameters;
+
+	ConfigurationTally Tally;
+
+	Configuration(std::string name, std::map<std::string, double> parameters) : Name(name), Parameters(parameters)
+	{
+	}
+
+	json ToJSON(int tag)
+	{
+		json j;
+		j["Tag"] = tag;
+		j["Name"] = Name;
+
+		for (auto& parameter : Parameters)
+			j[parameter.first] = parameter.second;
+
+		j["StartRays"] = Tally.StartRays;
+		j["StartPower"] = Tally.StartPower;
+		j["CapturedRays"] = Tally.CapturedRays;
+		j["CapturedPower"] = Tally.CapturedPower;
+		j["CapturedFraction"] = Tally.StartPower > 0.0 ? Tally.CapturedPower / Tally.StartPower : 0.0;
+		j["LostRays"] = Tally.LostRays;
+		j["LostPower"] = Tally.LostPower;
+		j["DestroyedRays"] = Tally.DestroyedRays;
+		j["DestroyedPower"] = Tally.DestroyedPower;
+		j["RouletteRays"] = Tally.RouletteRays;
+		j["InFlightRays"] = Tally.InFlightRays;
+		j["InFlightPower"] = Tally.InFlightPower;
+		return j;
+	}
+};
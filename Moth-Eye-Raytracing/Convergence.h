@@ -0,0 +1,119 @@
+#pragma once
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <functional>
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+// Two-sided 95% Student-t quantile, the normal 1.96 is far too narrow for a handful of repeats
+// Past 30 degrees of freedom the 30 entry is used, which only makes the interval slightly wider than it is
+double StudentT95(int degreesOfFreedom)
+{
+	static const double quantiles[30] = {
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+	};
+
+	return quantiles[std::min(std::max(degreesOfFreedom, 1), 30) - 1];
+}
+
+struct ConvergenceSettings
+{
+	// Stop once the 95% confidence interval on the mean is within +- TargetHalfWidth
+	double TargetHalfWidth = 0.005;
+
+	// Two close repeats happen by chance too often, a few more keep the sweep from stopping early on them
+	int MinRepeats = 4;
+
+	int MaxRepeats = 10;
+};
+
+struct ConvergenceResult
+{
+	std::vector<std::string> FilePaths;
+
+	// Configuration tag of each sample when a file holds several configurations, empty otherwise
+	std::vector<int> Tags;
+
+	std::vector<double> Samples;
+
+	double Mean = 0.0;
+
+	double StandardError = 0.0;
+
+	double HalfWidth = 0.0;
+
+	bool Converged = false;
+
+	json ToJSON()
+	{
+		json j;
+		j["FilePaths"] = FilePaths;
+
+		if (!Tags.empty())
+			j["Tags"] = Tags;
+
+		j["Samples"] = Samples;
+		j["Repeats"] = Samples.size();
+		j["Mean"] = Mean;
+		j["StandardError"] = StandardError;
+		j["HalfWidth"] = HalfWidth;
+		j["Converged"] = Converged;
+		return j;
+	}
+};
+
+// Adds one repeat to the result, returns true once the mean is known to the target width
+bool AddSample(ConvergenceResult& result, std::string filePath, double sample, ConvergenceSettings settings, int tag = -1)
+{
+	result.FilePaths.push_back(filePath);
+
+	if (tag >= 0)
+		result.Tags.push_back(tag);
+
+	result.Samples.push_back(sample);
+
+	int n = result.Samples.size();
+
+	double sum = 0.0;
+	double sumOfSquares = 0.0;
+
+	for (double value : result.Samples)
+	{
+		sum += value;
+		sumOfSquares += value * value;
+	}
+
+	result.Mean = sum / n;
+
+	if (n < 2)
+		return false;
+
+	double variance = std::max(0.0, (sumOfSquares - sum * sum / n) / (n - 1));
+
+	result.StandardError = std::sqrt(variance / n);
+	result.HalfWidth = StudentT95(n - 1) * result.StandardError;
+	result.Converged = n >= settings.MinRepeats && result.HalfWidth <= settings.TargetHalfWidth;
+
+	return result.Converged;
+}
+
+// Repeats runRepeat(repeatIndex, &sample) until the mean of the samples is known to the target width or MaxRepeats is hit
+ConvergenceResult RunUntilConverged(std::function<std::string(int, double*)> runRepeat, ConvergenceSettings settings)
+{
+	ConvergenceResult result;
+
+	for (int k = 0; k < settings.MaxRepeats; k++)
+	{
+		double sample = 0.0;
+		std::string filePath = runRepeat(k, &sample);
+
+		if (AddSample(result, filePath, sample, settings))
+			break;
+	}
+
+	return result;
+}
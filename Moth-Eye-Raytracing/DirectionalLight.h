@@ -28,7 +28,7 @@ public:
 		}
 	}
 
-	std::vector<Ray> GenerateRays() override
+	std::vector<Ray> GenerateRays(std::vector<SpectralBundle>& bundles) override
 	{
 		std::vector<Ray> rays;
 		std::vector<double> xs = linspace(A.X, B.X, NumberOfRays);
@@ -41,14 +41,15 @@ public:
 		if (Down && direction.Dot(Vec2(0, -1)) < 0)
 			direction = direction * -1;
 		
-		WavelengthGenerator& wg = *this->WavelengthGen;
-
 		for (int i = 0; i < NumberOfRays; i++)
 		{
+			RandomStream::Current().Select(i);
+
 			Vec2 pointOnLine = Vec2(xs[i], ys[i]);
 			
-			Ray ray = Ray(pointOnLine.X, pointOnLine.Y, direction.X, direction.Y, wg.GenerateWavelength());
+			Ray ray = Ray(pointOnLine.X, pointOnLine.Y, direction.X, direction.Y);
 			ray.CurrentMedium = this->CurrentMedium;
+			this->AssignWavelengths(ray, bundles);
 
 			rays.push_back(ray);
 		}
@@ -62,7 +63,7 @@ public:
 
 		obj->Type = "DirectionalLightSource";
 
-		obj->AddSegment(A.X, A.Y, B.X, B.Y, [](double) {return 1.0; }, this->PerturbanceGen);
+		obj->AddSegment(A.X, A.Y, B.X, B.Y, obj->AddMaterial([](double) {return 1.0; }, this->PerturbanceGen));
 
 		return obj;
 	}	
@@ -0,0 +1,95 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include "AliasTable.h"
+#include "RandomStream.h"
+using json = nlohmann::json;
+// Table of values and their probabilities, as written by DataAnalysis (AM15_spectrum.json, AngularDistribution/Distributions/*.json)
+struct TabulatedDistribution
+{
+public:
+
+	std::string Name;
+
+	std::vector<double> Values;
+
+	AliasTable Table;
+
+	double Sample()
+	{
+		return Values[Table.Sample(RandomStream::Current().Uniform())];
+	}
+
+	bool Empty()
+	{
+		return Values.empty();
+	}
+};
+
+// Loads every distribution file once per process, generators then share the parsed table and its alias table
+class DistributionRegistry
+{
+public:
+
+	// valueKey is the column sampled, "Wavelength" for spectra and "Angle" for angular distributions
+	// Returns nullptr if the file can't be read, the next call tries again
+	static TabulatedDistribution* Get(std::string filePath, std::string valueKey)
+	{
+		static std::mutex mutex;
+		static std::map<std::string, std::unique_ptr<TabulatedDistribution>> distributions;
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		std::string id = filePath + ":" + valueKey;
+		auto found = distributions.find(id);
+
+		if (found != distributions.end())
+			return found->second.get();
+
+		std::unique_ptr<TabulatedDistribution> distribution = Load(filePath, valueKey);
+
+		if (!distribution)
+			return nullptr;
+
+		TabulatedDistribution* result = distribution.get();
+		distributions[id] = std::move(distribution);
+
+		return result;
+	}
+
+private:
+
+	static std::unique_ptr<TabulatedDistribution> Load(std::string filePath, std::string valueKey)
+	{
+		std::ifstream file(filePath);
+		if (!file.is_open()) {
+			std::cerr << "Error: could not open JSON file " << filePath << "\n";
+			return nullptr;
+		}
+
+		json data;
+
+		file >> data;
+
+		std::vector<double> probability = data["Probability"].get<std::vector<double>>();
+
+		std::unique_ptr<TabulatedDistribution> distribution(new TabulatedDistribution());
+		distribution->Name = data.count("Name") > 0 ? data["Name"].get<std::string>() : filePath;
+		distribution->Values = data[valueKey].get<std::vector<double>>();
+		distribution->Table.Build(probability);
+
+		if (distribution->Values.size() != probability.size())
+		{
+			std::cerr << "Error: " << filePath << " has " << distribution->Values.size() << " " << valueKey << " values but " << probability.size() << " probabilities\n";
+			return nullptr;
+		}
+
+		return distribution;
+	}
+};
@@ -9,6 +9,7 @@
 #include "Mirror.h"
 #include "Target.h"
 #include "Wave.h"
+#include "LayerStack.h"
 #include <functional>
 #include "PointSource.h"
 #include "QuantumDot.h"
@@ -60,6 +61,8 @@ Scene CreateWaveguideBlock(std::string name, int waveguideLayers, double startX
 	std::vector<double> waveguideRefractiveIndex = linspace(1.0, 1.41, waveguideLayers);
 	std::vector<double> waveguidePosition = linspace(waveguideTopLeftY, waveguideBottomLeftY, waveguideLayers);
 
+	LayerStack* layers = new LayerStack(startX, endX);
+
 	for (int i = 0; i < waveguideLayers; i++)
 	{
 		double wy = waveguidePosition[i];
@@ -68,13 +71,11 @@ Scene CreateWaveguideBlock(std::string name, int waveguideLayers, double startX
 		if (useMothEyeIndex)
 			n = MothEyeRefractiveIndex(mothEyeHeight - wy);
 
-		Object* obj = new Object();
-
-		obj->AddSegment(startX, wy, endX, wy, [n](double) {return n;}, new ConstantPerturbance(0));
-
-		scene.AddObject(obj);
+		layers->AddLayer(wy, [n](double) {return n;}, new ConstantPerturbance(0));
 	}
 
+	scene.AddObject(layers);
+
 	return scene;
 }
 
@@ -472,12 +473,15 @@ void RealLifeTestUnitCell(int QDs, int waveguideLayers, double angle, int raysPe
 
 	std::vector<double> qdPositionsX = linspace(startX, endX, QDs + 2);
 
+	// Every dot shares one prototype centered on the origin
+	QuantumDot* qdPrototype = scene.AddPrototype(new QuantumDot(0.0, 0.0, qdRadius, QDResolution));
+
 	for (int i = 1; i < qdPositionsX.size() - 1; i++)
 	{
 		double ox = qdPositionsX[i];
 		double oy = -100;
 
-		scene.AddObject(new QuantumDot(ox, oy, qdRadius, QDResolution));
+		scene.AddObject(new ObjectInstance(qdPrototype, ox, oy));
 	}
 
 	std::cout << "Rendering : " << name << "... ";
@@ -517,12 +521,15 @@ void RealLifeTest(int QDs, int waveguideLayers, double angle, int raysPerQD = 10
 
 	std::vector<double> qdPositionsX = linspace(startX, endX, QDs + 2);
 
+	// Every dot shares one prototype centered on the origin
+	QuantumDot* qdPrototype = scene.AddPrototype(new QuantumDot(0.0, 0.0, qdRadius, QDResolution));
+
 	for (int i = 1; i < qdPositionsX.size() - 1; i++)
 	{
 		double ox = qdPositionsX[i];
 		double oy = -100;
 
-		scene.AddObject(new QuantumDot(ox, oy, qdRadius, QDResolution));
+		scene.AddObject(new ObjectInstance(qdPrototype, ox, oy));
 	}
 
 	std::cout << "Rendering : " << name << "... ";
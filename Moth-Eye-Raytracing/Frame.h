@@ -1,5 +1,6 @@
 #pragma once
 #include "Ray.h"
+#include "RayQueue.h"
 #include <vector>
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
@@ -7,7 +8,7 @@ class Frame
 {
 public:
 
-	std::vector<Ray> Rays;
+	RayQueue Rays;
 
 	int FrameNumber;
 
@@ -15,37 +16,53 @@ public:
 
 	int DestroyedRays;
 
+	// Rays ended by Russian roulette, their power lives on in the survivors so none is counted as lost
+	int RouletteRays;
+
 	float LostPower;
 
 	float DestroyedPower;
 
 	Frame(int frameNumber) : FrameNumber(frameNumber)
 	{
-		Rays = std::vector<Ray>();
+		Rays = RayQueue();
 		LostRays = 0;
 		DestroyedRays = 0;
+		RouletteRays = 0;
 		LostPower = 0.0f;
 		DestroyedPower = 0.0f;
 	}
 
-	void AddRay(Ray ray)
+	void AddRay(const Ray& ray, const std::vector<SpectralBundle>& bundles)
 	{
-		this->Rays.push_back(ray);
+		this->Rays.Push(ray, bundles);
+	}
+
+	void AddRays(const RayQueue& rays)
+	{
+		this->Rays.Append(rays);
 	}
 
 	json ToJSON()
 	{
 		json j;
 		j["FrameNumber"] = this->FrameNumber;
-		j["RayCount"] = this->Rays.size();
+		j["RayCount"] = this->Rays.Size();
 		j["LostRays"] = this->LostRays;
 		j["DestroyedRays"] = this->DestroyedRays;
+		j["RouletteRays"] = this->RouletteRays;
 		j["LostPower"] = this->LostPower;
 		j["DestroyedPower"] = this->DestroyedPower;
 		j["Rays"] = json::array();
 
-		for (Ray& ray : this->Rays)
-			j["Rays"].push_back(ray.ToJSON());
+		// Only the saved fields are read, the bundles are unpacked into a pool that is thrown away
+		std::vector<SpectralBundle> bundles;
+
+		for (size_t i = 0; i < this->Rays.Size(); i++)
+		{
+			bundles.clear();
+			j["Rays"].push_back(this->Rays.Get(i, bundles).ToJSON());
+		}
 
 		return j;
 	}
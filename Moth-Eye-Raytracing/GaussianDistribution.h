@@ -1,5 +1,5 @@
 #pragma once
-#include <random>
+#include "RandomStream.h"
 class GaussianDistribution
 {
 public:
@@ -8,16 +8,13 @@ public:
 
 	double Sigma;
 
-	std::mt19937 Generator;
-	std::normal_distribution<double> Distribution;
-
-	GaussianDistribution(double mu, double sigma) : Mu(mu), Sigma(sigma), Generator(std::random_device{}()), Distribution(mu, sigma)
+	GaussianDistribution(double mu, double sigma) : Mu(mu), Sigma(sigma)
 	{
 	}
 
 	double GetRandomValue()
 	{
-		return Distribution(Generator);
+		return RandomStream::Current().Normal(Mu, Sigma);
 	}
 };
 
@@ -0,0 +1,240 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "Object.h"
+// Surface y(x) sampled on a uniform grid in x, one segment per cell
+// Rays walk the cells they cross in x (1D DDA) instead of searching a BVH, skipping blocks of cells they pass above or below
+class HeightField : public Object
+{
+public:
+
+	static const int BLOCK_SIZE = 16;
+
+	double StartX;
+
+	double CellWidth;
+
+	HeightField() : Object()
+	{
+		Type = "HeightField";
+		this->StartX = 0.0;
+		this->CellWidth = 0.0;
+		this->IsGrid = false;
+	}
+
+	// Measured profile, heights[i] is the surface at startX + i * (endX - startX) / (heights.size() - 1)
+	HeightField(double startX, double endX, std::vector<double> heights, std::function<double(double)> refractiveIndex, PerturbanceGenerator* generator) : HeightField()
+	{
+		std::vector<double> x = linspace(startX, endX, heights.size());
+		int material = this->AddMaterial(refractiveIndex, generator);
+
+		for (int i = 0; i + 1 < heights.size(); i++)
+			this->AddSegment(x[i], heights[i], x[i + 1], heights[i + 1], material);
+	}
+
+	// Analytic profile sampled at resolution points
+	HeightField(double startX, double endX, int resolution, std::function<double(double)> height, std::function<double(double)> refractiveIndex, PerturbanceGenerator* generator) : HeightField(startX, endX, SampleHeights(startX, endX, resolution, height), refractiveIndex, generator)
+	{
+	}
+
+	// Orders the cells by x, anything that isn't a uniform single valued grid falls back to the Object BVH
+	void BVH(int threadCount = 1) override
+	{
+		Nodes.clear();
+		BlockMinY.clear();
+		BlockMaxY.clear();
+		Bounds = ObjectBounds();
+
+		IsGrid = BuildGrid();
+
+		if (!IsGrid)
+		{
+			Object::BVH(threadCount);
+			return;
+		}
+
+		for (int i = 0; i < Segments.Size(); i++)
+		{
+			Bounds.GrowToInclude(Segments, i);
+
+			double low = std::min(Segments.AY[i], Segments.BY[i]);
+			double high = std::max(Segments.AY[i], Segments.BY[i]);
+
+			if (i % BLOCK_SIZE == 0)
+			{
+				BlockMinY.push_back(low);
+				BlockMaxY.push_back(high);
+			}
+			else
+			{
+				BlockMinY.back() = std::min(BlockMinY.back(), low);
+				BlockMaxY.back() = std::max(BlockMaxY.back(), high);
+			}
+		}
+
+		ObjectNode root = ObjectNode();
+		root.Bounds = Bounds;
+		root.Start = 0;
+		root.Count = Segments.Size();
+		Nodes.push_back(root);
+	}
+
+	RayHit Intersect(Ray* ray, int* nodeVisits = nullptr) override
+	{
+		if (!IsGrid)
+			return Object::Intersect(ray, nodeVisits);
+
+		double tEnter, tExit;
+
+		if (Segments.Empty() || !Bounds.Intersects(ray, tEnter, tExit))
+			return RayHit(false, 0.0, -1);
+
+		int cellCount = Segments.Size();
+		double originX = ray->Origin.X;
+		double directionX = ray->Direction.X;
+
+		int cell = GetCell(originX + directionX * tEnter);
+
+		// Vertical rays stay in one cell, the neighbours cover a ray running down a shared vertex
+		if (std::abs(directionX) <= EPSILON)
+			return IntersectCells(ray, std::max(cell - 1, 0), std::min(cell + 1, cellCount - 1), nodeVisits);
+
+		int step = directionX > 0 ? 1 : -1;
+		double inverseX = 1.0 / directionX;
+
+		// Starting one cell back absorbs rounding when the ray leaves from a shared vertex
+		cell = std::min(std::max(cell - step, 0), cellCount - 1);
+
+		while (cell >= 0 && cell < cellCount)
+		{
+			int block = cell / BLOCK_SIZE;
+			int blockStart = block * BLOCK_SIZE;
+			int blockEnd = std::min(blockStart + BLOCK_SIZE, cellCount);
+
+			if (nodeVisits != nullptr)
+				(*nodeVisits)++;
+
+			// Part of the ray over this block, widened by the grid tolerance and clipped to the bounds
+			double tA = (StartX + blockStart * CellWidth - GRID_TOLERANCE * CellWidth - originX) * inverseX;
+			double tB = (StartX + blockEnd * CellWidth + GRID_TOLERANCE * CellWidth - originX) * inverseX;
+			double tLow = std::max(std::min(tA, tB), tEnter);
+			double tHigh = std::min(std::max(tA, tB), tExit);
+
+			if (tLow > tExit)
+				break;
+
+			double yLow = ray->Origin.Y + ray->Direction.Y * tLow;
+			double yHigh = ray->Origin.Y + ray->Direction.Y * tHigh;
+
+			if (yLow > yHigh)
+				std::swap(yLow, yHigh);
+
+			int last = step > 0 ? blockEnd - 1 : blockStart;
+
+			if (tLow <= tHigh && yHigh >= BlockMinY[block] && yLow <= BlockMaxY[block])
+			{
+				// Cells are visited in order along the ray, so the first hit is the closest
+				for (; cell != last + step; cell += step)
+				{
+					RayHit hit = Segments.Intersect(cell, ray);
+
+					if (hit.Hit)
+						return hit;
+				}
+			}
+
+			cell = last + step;
+		}
+
+		return RayHit(false, 0.0, -1);
+	}
+
+private:
+
+	// Allowed misplacement of a cell edge, as a fraction of CellWidth
+	const double GRID_TOLERANCE = 1e-9;
+
+	bool IsGrid;
+
+	std::vector<double> BlockMinY;
+
+	std::vector<double> BlockMaxY;
+
+	static std::vector<double> SampleHeights(double startX, double endX, int resolution, std::function<double(double)> height)
+	{
+		std::vector<double> heights;
+
+		for (int i = 0; i < resolution; i++)
+			heights.push_back(height(resolution > 1 ? startX + (endX - startX) * i / (resolution - 1) : startX));
+
+		return heights;
+	}
+
+	int GetCell(double x)
+	{
+		int cell = (int)std::floor((x - StartX) / CellWidth);
+		return std::min(std::max(cell, 0), Segments.Size() - 1);
+	}
+
+	RayHit IntersectCells(Ray* ray, int first, int last, int* nodeVisits)
+	{
+		double minT = INFINITY;
+		int closestSegment = -1;
+
+		if (nodeVisits != nullptr)
+			(*nodeVisits)++;
+
+		for (int i = first; i <= last; i++)
+		{
+			RayHit hit = Segments.Intersect(i, ray);
+
+			if (hit.Hit && hit.Distance < minT)
+			{
+				minT = hit.Distance;
+				closestSegment = i;
+			}
+		}
+
+		if (closestSegment < 0)
+			return RayHit(false, 0.0, -1);
+
+		return RayHit(true, minT, closestSegment);
+	}
+
+	// Sorts the cells by x and checks they tile [StartX, StartX + n * CellWidth] without gaps
+	bool BuildGrid()
+	{
+		if (Segments.Empty())
+			return false;
+
+		int count = Segments.Size();
+		std::vector<int> order = std::vector<int>(count);
+
+		for (int i = 0; i < count; i++)
+			order[i] = i;
+
+		std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return std::min(Segments.AX[a], Segments.BX[a]) < std::min(Segments.AX[b], Segments.BX[b]); });
+		Segments.Reorder(order);
+
+		StartX = std::min(Segments.AX[0], Segments.BX[0]);
+		double endX = std::max(Segments.AX[count - 1], Segments.BX[count - 1]);
+		CellWidth = (endX - StartX) / count;
+
+		if (CellWidth <= EPSILON)
+			return false;
+
+		double tolerance = GRID_TOLERANCE * CellWidth;
+
+		for (int i = 0; i < count; i++)
+		{
+			double low = std::min(Segments.AX[i], Segments.BX[i]);
+			double high = std::max(Segments.AX[i], Segments.BX[i]);
+
+			if (std::abs(low - (StartX + i * CellWidth)) > tolerance || std::abs(high - (StartX + (i + 1) * CellWidth)) > tolerance)
+				return false;
+		}
+
+		return true;
+	}
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include "Vec2.h"
+#include "Material.h"
+// What an interaction needs to know about a hit, worked out once per event by Object::GetHitContext
+// Position is in the space of the object that made it, for an ObjectInstance that is its prototype's space
+struct HitContext
+{
+public:
+
+	// Index into the hit Object's Segments, -1 for analytic shapes which work out their own surface
+	int Segment = -1;
+
+	double Distance = 0.0;
+
+	Vec2 Position;
+
+	// Perturbed unit normal facing the incoming ray, shared by the reflected and transmitted rays
+	Vec2 Normal;
+
+	// Against Normal, never negative
+	double IncidentCos = 0.0;
+
+	Material* SurfaceMaterial = nullptr;
+};
@@ -0,0 +1,136 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "Object.h"
+// Horizontal layers spanning [StartX, EndX], the next interface is found from the ray's layer instead of a segment search
+class LayerStack : public Object
+{
+public:
+
+	double StartX;
+
+	double EndX;
+
+	// Layer heights in increasing order, Heights[i] belongs to Segments[i]
+	std::vector<double> Heights;
+
+	LayerStack(double startX, double endX) : Object()
+	{
+		Type = "LayerStack";
+
+		this->StartX = std::min(startX, endX);
+		this->EndX = std::max(startX, endX);
+		this->Spacing = 0.0;
+		this->IsUniform = false;
+	}
+
+	void AddLayer(double y, std::function<double(double)> refractiveIndex, PerturbanceGenerator* generator)
+	{
+		AddSegment(StartX, y, EndX, y, AddMaterial(refractiveIndex, generator));
+	}
+
+	// Sorts the layers by height, the whole stack is a single leaf so the scene BVH only sees its bounds
+	void BVH(int /*threadCount*/ = 1) override
+	{
+		Nodes.clear();
+		Heights.clear();
+		Bounds = ObjectBounds();
+
+		std::vector<int> order = std::vector<int>(Segments.Size());
+
+		for (size_t i = 0; i < order.size(); i++)
+			order[i] = i;
+
+		std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return Segments.AY[a] < Segments.AY[b]; });
+		Segments.Reorder(order);
+
+		for (int i = 0; i < Segments.Size(); i++)
+		{
+			Heights.push_back(Segments.AY[i]);
+			Bounds.GrowToInclude(Segments, i);
+		}
+
+		if (Segments.Empty())
+			return;
+
+		ObjectNode root = ObjectNode();
+		root.Bounds = Bounds;
+		root.Start = 0;
+		root.Count = Segments.Size();
+		Nodes.push_back(root);
+
+		// Evenly spaced layers (linspace) let the current layer be computed directly from y
+		int count = Heights.size();
+		Spacing = count > 1 ? (Heights[count - 1] - Heights[0]) / (count - 1) : 0.0;
+		IsUniform = Spacing > 0.0;
+
+		for (int i = 0; i < count && IsUniform; i++)
+			if (std::abs(Heights[i] - (Heights[0] + i * Spacing)) > 1e-9 * Spacing)
+				IsUniform = false;
+	}
+
+	// Same hit rules as SegmentArray::Intersect on every layer, but only the neighbouring interface is tested
+	RayHit Intersect(Ray* ray, int* nodeVisits = nullptr) override
+	{
+		int count = Heights.size();
+
+		if (count == 0 || std::abs(ray->Direction.Y * (EndX - StartX)) <= EPSILON)
+			return RayHit(false, 0.0, -1);
+
+		if (nodeVisits != nullptr)
+			(*nodeVisits)++;
+
+		double y = ray->Origin.Y;
+		double minStep = EPSILON * std::abs(ray->Direction.Y);
+		int index;
+
+		// Upwards the next interface is the first one at least EPSILON along the ray, downwards the last one
+		if (ray->Direction.Y > 0)
+			index = LayersBelow(y + minStep);
+		else
+			index = LayersBelow(y - minStep) - 1;
+
+		if (index < 0 || index >= count)
+			return RayHit(false, 0.0, -1);
+
+		double t = (Heights[index] - y) / ray->Direction.Y;
+
+		if (t < EPSILON)
+			return RayHit(false, 0.0, -1);
+
+		double x = ray->Origin.X + ray->Direction.X * t;
+
+		// Leaving through the side of the stack, the walls are separate objects
+		if (x < StartX || x > EndX)
+			return RayHit(false, 0.0, -1);
+
+		return RayHit(true, t, index);
+	}
+
+private:
+
+	double Spacing;
+
+	bool IsUniform;
+
+	// Number of layers with a height strictly below y
+	int LayersBelow(double y)
+	{
+		int count = Heights.size();
+
+		if (!IsUniform)
+			return std::lower_bound(Heights.begin(), Heights.end(), y) - Heights.begin();
+
+		double position = std::ceil((y - Heights[0]) / Spacing);
+		int index = position < 0.0 ? 0 : (position > count ? count : (int)position);
+
+		// Rounding in the division can leave the estimate one layer off
+		while (index > 0 && Heights[index - 1] >= y)
+			index--;
+
+		while (index < count && Heights[index] < y)
+			index++;
+
+		return index;
+	}
+};
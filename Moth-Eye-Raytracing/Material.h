@@ -0,0 +1,26 @@
+#pragma once
+#include <functional>
+#include "PerturbanceGenerator.h"
+// Dispersion and roughness of a surface, shared by every segment of an Object that indexes it
+class Material
+{
+public:
+
+	std::function<double(double)> RefractiveIndexFunction;
+
+	PerturbanceGenerator* PerturbanceGen;
+
+	Material(std::function<double(double)> refractiveIndexFunc, PerturbanceGenerator* perturbanceGen) : RefractiveIndexFunction(refractiveIndexFunc), PerturbanceGen(perturbanceGen)
+	{
+	}
+
+	double GetRefractiveIndex(double wavelength)
+	{
+		return RefractiveIndexFunction(wavelength);
+	}
+
+	double GetPerturbance()
+	{
+		return PerturbanceGen->GeneratePerturbance();
+	}
+};
@@ -10,17 +10,14 @@ public:
 	{
 		Type = "Mirror";
 
-		this->AddSegment(x1, y1, x2, y2, [](double) {return 1.0;}, &PerturbanceGenerator);
+		this->AddSegment(x1, y1, x2, y2, this->AddMaterial([](double) {return 1.0;}, &PerturbanceGenerator));
 	}
 
-	std::vector<Ray> InteractWithRay(Segment* segment, Ray* ray) override
+	void InteractWithRay(HitContext& hit, Ray* ray, std::vector<Ray>& output, std::vector<SpectralBundle>&) override
 	{
-		segment->Reflect(ray);
+		Reflect(hit, ray);
 
-		std::vector<Ray> resultingRays;
-		resultingRays.push_back(*ray);
-
-		return resultingRays;
+		output.push_back(*ray);
 	}
 };
 
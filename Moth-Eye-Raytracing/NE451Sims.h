@@ -2,6 +2,8 @@
 #include <functional>
 #include <cmath>
 #include "NormalPerturbance.h"
+#include "Convergence.h"
+#include "UniformWavelengthGenerator.h"
 
 double SellmeierMicron(double wavelength)
 {
@@ -76,7 +78,7 @@ double GetRefractiveIndexPDMS(double x, double y, double wavelength)
 
 Object* CreateWave(double x1, double y1, double x2, double y2, int resolution, std::function<double(double)> refractiveIndex, PerturbanceGenerator* generator, double A = 1.0, double B = 1.0, double C = 1.0, double D = 1.0)
 {
-	Object* obj = new Object();
+	HeightField* obj = new HeightField();
 
 
 	obj->Type = "Wave";
@@ -89,17 +91,23 @@ Object* CreateWave(double x1, double y1, double x2, double y2, int resolution, s
 		yShift[i] += A * sin(phase) + D;
 	}
 
+	int material = obj->AddMaterial(refractiveIndex, generator);
+
 	for (int i = 0; i < resolution - 1; i++)
 	{
-		obj->AddSegment(x[i], yShift[i], x[i + 1], yShift[i + 1], refractiveIndex, generator);
+		obj->AddSegment(x[i], yShift[i], x[i + 1], yShift[i + 1], material);
 	}
 
 	return obj;
 }
 
+// Sweeps stop once this fraction of the start power is still in flight, well below the 3 significant figures they report
+const double SWEEP_IN_FLIGHT_FRACTION = 1e-4;
+
 Scene CreateUnitCellWaveguideBlock(std::string name, int waveguideLayers, PerturbanceGenerator* pertubance, double startX = -125, double endX = 125)
 {
 	Scene scene = Scene(name);
+	scene.MinInFlightFraction = SWEEP_IN_FLIGHT_FRACTION;
 
 	double mothEyeHeight = 250.0;
 
@@ -120,24 +128,25 @@ Scene CreateUnitCellWaveguideBlock(std::string name, int waveguideLayers, Pertur
 
 	std::vector<double> waveguidePosition = linspace(waveguideTopLeftY, waveguideBottomLeftY, waveguideLayers);
 
+	LayerStack* layers = new LayerStack(startX, endX);
+
 	for (int i = 0; i < waveguideLayers; i++)
 	{
 		double wy = waveguidePosition[i];
 		double heightFraction = (mothEyeHeight - wy) / mothEyeHeight;
 
-		Object* obj = new Object();
-
-		obj->AddSegment(startX, wy, endX, wy, CreateEffectiveRefractiveIndexFunction(heightFraction), pertubance);
-
-		scene.AddObject(obj);
+		layers->AddLayer(wy, CreateEffectiveRefractiveIndexFunction(heightFraction), pertubance);
 	}
 
+	scene.AddObject(layers);
+
 	return scene;
 }
 
 Scene CreateUnitCellWaveWaveguideBlock(std::string name, int waveguideLayers, PerturbanceGenerator* pertubance, double startX = -125, double endX = 125)
 {
 	Scene scene = Scene(name);
+	scene.MinInFlightFraction = SWEEP_IN_FLIGHT_FRACTION;
 
 	int waveResolution = 500;
 
@@ -175,7 +184,7 @@ Scene CreateUnitCellWaveWaveguideBlock(std::string name, int waveguideLayers, Pe
 	return scene;
 }
 
-std::string RunWavelengthSweep(std::string path, int numOfLayers, double wavelength, int numOfRays, int avgIndex, double angle)
+std::string RunWavelengthSweep(std::string path, int numOfLayers, double wavelength, int numOfRays, int avgIndex, double angle, double* capturedFraction = nullptr)
 {
 	double startX = -125.0;
 	double endX = 125.0;
@@ -203,12 +212,58 @@ std::string RunWavelengthSweep(std::string path, int numOfLayers, double wavelen
 
 	scene.Render(true, false, false, true, false, filePath);
 
+	if (capturedFraction != nullptr)
+		*capturedFraction = scene.Stats.CapturedPower / scene.Stats.StartPower;
+
+	filePath += "/" + name;
+
+	return filePath;
+}
+
+// Whole spectral response of the block in one scene, every ray carries SPECTRAL_SAMPLES wavelengths spread over the range
+std::string RunSpectralSweep(std::string path, int numOfLayers, double minWavelength, double maxWavelength, int binCount, int numOfRays, int avgIndex, double angle, double* capturedFraction = nullptr)
+{
+	double startX = -125.0;
+	double endX = 125.0;
+	double sourceHeight = 300.0;
+
+	std::string filePath = path + "/AVG_" + std::to_string(avgIndex);
+	CreateFolder(filePath);
+
+	std::string name = "SpectralSweep";
+
+	Scene scene = CreateUnitCellWaveguideBlock(name, numOfLayers, new ConstantPerturbance(0), startX, endX);
+
+	scene.AddObject(new Mirror(startX, 500.0, startX, 0));
+	scene.AddObject(new Mirror(endX, 500.0, endX, 0));
+
+	double pi = 3.14159265358979323846;
+	double radians = angle * pi / 180.0;
+	double emitterLength = (endX - startX) * 0.95;
+
+	double xStart = -(cos(radians) * emitterLength) + endX * 0.95;
+	double yStart = sin(radians) * emitterLength + sourceHeight;
+
+	DirectionalLight* light = new DirectionalLight(xStart, yStart, endX * 0.95, sourceHeight, numOfRays, new UniformWavelengthGenerator(minWavelength, maxWavelength), new ConstantPerturbance(0));
+	light->SpectralSamples = SPECTRAL_SAMPLES;
+
+	scene.AddRaySource(light);
+	scene.Response = SpectralResponse(minWavelength, maxWavelength, binCount);
+
+	// Spreads the hero wavelengths evenly over the bins
+	scene.Sampling = SamplingMode::Sobol;
+
+	scene.Render(true, false, false, true, false, filePath);
+
+	if (capturedFraction != nullptr)
+		*capturedFraction = scene.Stats.CapturedPower / scene.Stats.StartPower;
+
 	filePath += "/" + name;
 
 	return filePath;
 }
 
-std::string RunAMG15GLayerSweeps(std::string path, int numOfLayers, int numOfRays, int avgIndex, double angle)
+std::string RunAMG15GLayerSweeps(std::string path, int numOfLayers, int numOfRays, int avgIndex, double angle, double* capturedFraction = nullptr)
 {
 	double startX = -125.0;
 	double endX = 125.0;
@@ -235,12 +290,73 @@ std::string RunAMG15GLayerSweeps(std::string path, int numOfLayers, int numOfRay
 
 	scene.Render(true, false, false, true, false, filePath);
 
+	if (capturedFraction != nullptr)
+		*capturedFraction = scene.Stats.CapturedPower / scene.Stats.StartPower;
+
 	filePath += "/" + name;
 
 	return filePath;
 }
 
-std::string RunNormalPerturbance(std::string path, int numOfLayers, int numOfRays, int avgIndex, double angle, double perturbanceDeviation)
+// Every (angle, repeat) pair is a configuration of one scene, so the layers are built and baked once for all of them
+// capturedFractions[a][k] is the captured fraction of angles[a] in repeat firstRepeat + k
+std::string RunAM15GConfigurationSweep(std::string path, int numOfLayers, int numOfRays, std::vector<int> angles, int firstRepeat, int repeats, std::vector<std::vector<double>>* capturedFractions = nullptr)
+{
+	double startX = -125.0;
+	double endX = 125.0;
+	double sourceHeight = 300.0;
+
+	std::string filePath = path + "/Layers_" + std::to_string(numOfLayers);
+	CreateFolder(filePath);
+
+	std::string name = "AM15G_AVG_" + std::to_string(firstRepeat);
+
+	Scene scene = CreateUnitCellWaveguideBlock(name, numOfLayers, new ConstantPerturbance(0), startX, endX);
+
+	scene.AddObject(new Mirror(startX, 500.0, startX, 0));
+	scene.AddObject(new Mirror(endX, 500.0, endX, 0));
+
+	// Breadth-first generations grow with the number of configurations, depth-first memory only with the split tree depth
+	scene.Order = BakeOrder::DepthFirst;
+
+	double pi = 3.14159265358979323846;
+	double emitterLength = (endX - startX) * 0.95;
+
+	for (int angle : angles)
+	{
+		double radians = angle * pi / 180.0;
+
+		double xStart = -(cos(radians) * emitterLength) + endX * 0.95;
+		double yStart = sin(radians) * emitterLength + sourceHeight;
+
+		for (int k = firstRepeat; k < firstRepeat + repeats; k++)
+		{
+			int tag = scene.AddConfiguration("Angle_" + std::to_string(angle) + "_AVG_" + std::to_string(k), { { "Angle", (double)angle }, { "Repeat", (double)k } });
+
+			scene.AddRaySource(new DirectionalLight(xStart, yStart, endX * 0.95, sourceHeight, numOfRays, new AM15GWavelengthGenerator(), new ConstantPerturbance(0)), tag);
+		}
+	}
+
+	scene.Render(true, false, false, true, false, filePath);
+
+	if (capturedFractions != nullptr)
+	{
+		*capturedFractions = std::vector<std::vector<double>>(angles.size(), std::vector<double>(repeats, 0.0));
+
+		for (int tag = 0; tag < scene.Configurations.size(); tag++)
+		{
+			ConfigurationTally& tally = scene.Configurations[tag].Tally;
+
+			(*capturedFractions)[tag / repeats][tag % repeats] = tally.StartPower > 0.0 ? tally.CapturedPower / tally.StartPower : 0.0;
+		}
+	}
+
+	filePath += "/" + name;
+
+	return filePath;
+}
+
+std::string RunNormalPerturbance(std::string path, int numOfLayers, int numOfRays, int avgIndex, double angle, double perturbanceDeviation, double* capturedFraction = nullptr)
 {
 	double startX = -125.0;
 	double endX = 125.0;
@@ -274,12 +390,15 @@ std::string RunNormalPerturbance(std::string path, int numOfLayers, int numOfRay
 
 	scene.Render(true, false, false, true, false, filePath);
 
+	if (capturedFraction != nullptr)
+		*capturedFraction = scene.Stats.CapturedPower / scene.Stats.StartPower;
+
 	filePath += "/" + name;
 
 	return filePath;
 }
 
-std::string RunWavyNormalPerturbance(std::string path, int numOfLayers, int numOfRays, int avgIndex, double angle, double perturbanceDeviation)
+std::string RunWavyNormalPerturbance(std::string path, int numOfLayers, int numOfRays, int avgIndex, double angle, double perturbanceDeviation, double* capturedFraction = nullptr)
 {
 	double startX = -500.0;
 	double endX = 500.0;
@@ -313,6 +432,9 @@ std::string RunWavyNormalPerturbance(std::string path, int numOfLayers, int numO
 
 	scene.Render(true, false, false, true, false, filePath);
 
+	if (capturedFraction != nullptr)
+		*capturedFraction = scene.Stats.CapturedPower / scene.Stats.StartPower;
+
 	filePath += "/" + name;
 
 	return filePath;
@@ -325,9 +447,13 @@ void RunSimulationCategory1()
 
 	std::string filePath = "Simulations/Simulation1_WavelengthSweep/";
 
-	AM15GWavelengthGenerator wg = AM15GWavelengthGenerator();
+	TabulatedDistribution* spectrum = DistributionRegistry::Get("AM15_spectrum.json", "Wavelength");
+	std::vector<double> wavelengths = spectrum != nullptr ? spectrum->Values : std::vector<double>();
+
+	if (wavelengths.empty())
+		return;
 
-	int avg = 5; //5
+	ConvergenceSettings convergence = ConvergenceSettings();
 	int numOfRays = 100;
 	int maxLayers = 100; //100
 	int maxAngle = 60; //60
@@ -336,7 +462,7 @@ void RunSimulationCategory1()
 	int layerStep = 5;
 	int wavelengthStep = 5;
 
-	int totalRuns = ((maxAngle / angleStep) + 1) * ((maxLayers - 5) / layerStep + 1) * avg;
+	int totalPoints = ((maxAngle / angleStep) + 1) * ((maxLayers - 5) / layerStep + 1);
 	int simIndex = 0;
 
 	json j;
@@ -355,43 +481,31 @@ void RunSimulationCategory1()
 
 		for (int i = 5; i <= maxLayers; i += layerStep)
 		{
-			json j_layer;
-
 			std::string layerName = "Layers_" + std::to_string(i);
 
 			std::string layerFilePath = angleFilePath + "/" + layerName;
 
 			CreateFolder(layerFilePath);
 
-			for (int k = 0; k < avg; k++)
-			{
-				auto start = std::chrono::high_resolution_clock::now();
-
-				std::string avgName = "Avg_" + std::to_string(k);
+			auto start = std::chrono::high_resolution_clock::now();
 
-				std::vector<std::string> filePaths = std::vector<std::string>();
+			// Same number of wavelength samples per bin as numOfRays monochromatic rays at every wavelengthStep-th wavelength
+			int binCount = wavelengths.size() / wavelengthStep;
+			int spectralRays = numOfRays * binCount / SPECTRAL_SAMPLES;
 
-				for (int j = 0; j <= wg.Wavelengths.size(); j += wavelengthStep)
-				{
-					filePaths.push_back(RunWavelengthSweep(layerFilePath, i, wg.Wavelengths[j], numOfRays, k, a));
+			ConvergenceResult result = RunUntilConverged([&](int k, double* sample) { return RunSpectralSweep(layerFilePath, i, wavelengths.front(), wavelengths.back(), binCount, spectralRays, k, a, sample); }, convergence);
 
-					double percentComplete = ((double)j / (double)wg.Wavelengths.size()) * 100.0;
-				}
+			j_angle[layerName] = result.ToJSON();
 
-				j_layer[avgName] = filePaths;
+			simIndex++;
 
-				simIndex++;
-
-				double percentComplete = ((double)simIndex / (double)totalRuns) * 100.0;
-
-				auto end = std::chrono::high_resolution_clock::now();
+			double percentComplete = ((double)simIndex / (double)totalPoints) * 100.0;
 
-				double timeTakenMS = std::chrono::duration<double, std::milli>(end - start).count();
+			auto end = std::chrono::high_resolution_clock::now();
 
-				std::cout << "Completed Sweep : " << percentComplete << "%" << " (" << timeTakenMS << " ms)" << std::endl;
-			}
+			double timeTakenMS = std::chrono::duration<double, std::milli>(end - start).count();
 
-			j_angle[layerName] = j_layer;
+			std::cout << "Completed Sweep : " << percentComplete << "%" << " (" << result.Samples.size() << " Repeats, " << timeTakenMS << " ms)" << std::endl;
 
 			std::cout << "Completed Layer Count: " << i << std::endl;
 		}
@@ -411,7 +525,7 @@ void RunSimulationCategory2()
 
 	std::string filePath = "Simulations/Simulation2_AM15GSpectrum/";
 
-	int avg = 5; //5
+	ConvergenceSettings convergence = ConvergenceSettings();
 	int numOfRays = 10000;
 	int maxLayers = 100; //100
 	int maxAngle = 60; //60
@@ -419,54 +533,76 @@ void RunSimulationCategory2()
 	int angleStep = 20;
 	int layerStep = 5;
 
-	int totalRuns = ((maxAngle / angleStep) + 1) * ((maxLayers - 5) / layerStep + 1) * avg;
+	std::vector<int> angles;
+
+	for (int a = 0; a <= maxAngle; a += angleStep)
+		angles.push_back(a);
+
+	int totalPoints = (maxLayers - 5) / layerStep + 1;
 	int simIndex = 0;
 
 	json j;
 
-	for (int a = 0; a <= maxAngle; a += angleStep)
+	for (int i = 5; i <= maxLayers; i += layerStep)
 	{
-		json j_angle;
+		std::string layerName = "Layers_" + std::to_string(i);
 
-		std::cout << "Starting Angle: " << a << " degrees" << std::endl;
+		auto start = std::chrono::high_resolution_clock::now();
 
-		std::string angleName = "Angle_" + std::to_string(a);
-
-		std::string angleFilePath = filePath + angleName;
+		std::vector<ConvergenceResult> results = std::vector<ConvergenceResult>(angles.size());
 
-		CreateFolder(angleFilePath);
+		int firstRepeat = 0;
+		int repeats = convergence.MinRepeats;
+		int bakes = 0;
 
-		for (int i = 5; i <= maxLayers; i += layerStep)
+		// Angles only differ in their source, so every angle still short of the target width shares one bake per pass
+		// Each pass builds its own scene, a pass only adds sources for the angles and repeats it runs
+		while (firstRepeat < convergence.MaxRepeats)
 		{
-			json j_layer;
+			std::vector<int> pending;
+			std::vector<int> pendingAngles;
 
-			std::string layerName = "Layers_" + std::to_string(i);
+			for (int a = 0; a < angles.size(); a++)
+			{
+				if (results[a].Converged)
+					continue;
 
-			std::vector<std::string> filePaths = std::vector<std::string>();
+				pending.push_back(a);
+				pendingAngles.push_back(angles[a]);
+			}
 
-			for (int k = 0; k < avg; k++)
-			{
-				auto start = std::chrono::high_resolution_clock::now();
+			if (pending.empty())
+				break;
 
-				filePaths.push_back(RunAMG15GLayerSweeps(angleFilePath, i, numOfRays, k, a));
+			repeats = std::min(repeats, convergence.MaxRepeats - firstRepeat);
 
-				simIndex++;
+			std::vector<std::vector<double>> capturedFractions;
+			std::string sweepPath = RunAM15GConfigurationSweep(filePath, i, numOfRays, pendingAngles, firstRepeat, repeats, &capturedFractions);
 
-				double percentComplete = ((double)simIndex / (double)totalRuns) * 100.0;
+			// Every sample of the pass is in the same file, the tag picks its entry out of the file's Configurations
+			for (int p = 0; p < pending.size(); p++)
+				for (int k = 0; k < repeats; k++)
+					AddSample(results[pending[p]], sweepPath, capturedFractions[p][k], convergence, p * repeats + k);
 
-				auto end = std::chrono::high_resolution_clock::now();
+			firstRepeat += repeats;
+			repeats = 1;
+			bakes++;
+		}
 
-				double timeTakenMS = std::chrono::duration<double, std::milli>(end - start).count();
+		for (int a = 0; a < angles.size(); a++)
+			j["Angle_" + std::to_string(angles[a])][layerName] = results[a].ToJSON();
 
-				std::cout << "Completed Render : " << percentComplete << "%" << " (" << timeTakenMS << " ms)" << std::endl;
-			}
+		simIndex++;
 
-			j_angle[layerName] = filePaths;
+		double percentComplete = ((double)simIndex / (double)totalPoints) * 100.0;
 
-			std::cout << "Completed Layer Count: " << i << std::endl;
-		}
+		auto end = std::chrono::high_resolution_clock::now();
 
-		j[angleName] = j_angle;
+		double timeTakenMS = std::chrono::duration<double, std::milli>(end - start).count();
+
+		std::cout << "Completed Render : " << percentComplete << "%" << " (" << angles.size() << " Angles in " << bakes << " Bakes, " << timeTakenMS << " ms)" << std::endl;
+
+		std::cout << "Completed Layer Count: " << i << std::endl;
 	}
 
 	std::ofstream file("Simulations/Simulation2_AM15GSpectrum/FilePaths.json");
@@ -481,7 +617,7 @@ void RunSimulationCategory3()
 
 	std::string filePath = "Simulations/Simulation3_NormalPerturbance/";
 
-	int avg = 5; //5
+	ConvergenceSettings convergence = ConvergenceSettings();
 	int numOfRays = 10000;
 	int maxLayers = 100; //100
 	int maxAngle = 60; //60
@@ -490,7 +626,7 @@ void RunSimulationCategory3()
 	int angleStep = 20;
 	int layerStep = 5;
 
-	int totalRuns = ((maxAngle / angleStep) + 1) * ((maxLayers - 5) / layerStep + 1) * avg * maxPerturbanceDev/2.0;
+	int totalPoints = ((maxAngle / angleStep) + 1) * ((maxLayers - 5) / layerStep + 1) * (maxPerturbanceDev / 2 + 1);
 	int simIndex = 0;
 
 	json j;
@@ -519,30 +655,23 @@ void RunSimulationCategory3()
 
 			for (int i = 5; i <= maxLayers; i += layerStep)
 			{
-				json j_layer;
-
 				std::string layerName = "Layers_" + std::to_string(i);
 
-				std::vector<std::string> filePaths = std::vector<std::string>();
-
-				for (int k = 0; k < avg; k++)
-				{
-					auto start = std::chrono::high_resolution_clock::now();
+				auto start = std::chrono::high_resolution_clock::now();
 
-					filePaths.push_back(RunNormalPerturbance(perturbanceFilePath, i, numOfRays, k, a, p));
+				ConvergenceResult result = RunUntilConverged([&](int k, double* sample) { return RunNormalPerturbance(perturbanceFilePath, i, numOfRays, k, a, p, sample); }, convergence);
 
-					simIndex++;
+				j_perturbance[layerName] = result.ToJSON();
 
-					double percentComplete = ((double)simIndex / (double)totalRuns) * 100.0;
+				simIndex++;
 
-					auto end = std::chrono::high_resolution_clock::now();
+				double percentComplete = ((double)simIndex / (double)totalPoints) * 100.0;
 
-					double timeTakenMS = std::chrono::duration<double, std::milli>(end - start).count();
+				auto end = std::chrono::high_resolution_clock::now();
 
-					std::cout << "Completed Render : " << percentComplete << "%" << " (" << timeTakenMS << " ms)" << std::endl;
-				}
+				double timeTakenMS = std::chrono::duration<double, std::milli>(end - start).count();
 
-				j_perturbance[layerName] = filePaths;
+				std::cout << "Completed Render : " << percentComplete << "%" << " (" << result.Samples.size() << " Repeats, +- " << result.HalfWidth << ", " << timeTakenMS << " ms)" << std::endl;
 
 				std::cout << "Completed Layer Count: " << i << std::endl;
 			}
@@ -565,7 +694,7 @@ void RunSimulationCategory4()
 
 	std::string filePath = "Simulations/Simulation4_WavyNormalPerturbance/";
 
-	int avg = 5;//5
+	ConvergenceSettings convergence = ConvergenceSettings();
 	int numOfRays = 10000;
 	int maxLayers = 100; //100
 	int maxAngle = 60; //60
@@ -574,7 +703,7 @@ void RunSimulationCategory4()
 	int angleStep = 20;
 	int layerStep = 5;
 
-	int totalRuns = ((maxAngle / angleStep) + 1) * ((maxLayers - 5) / layerStep + 1) * avg * maxPerturbanceDev/2.0;
+	int totalPoints = ((maxAngle / angleStep) + 1) * ((maxLayers - 5) / layerStep + 1) * (maxPerturbanceDev / 2 + 1);
 	int simIndex = 0;
 
 	json j;
@@ -603,30 +732,23 @@ void RunSimulationCategory4()
 
 			for (int i = 5; i <= maxLayers; i += layerStep)
 			{
-				json j_layer;
-
 				std::string layerName = "Layers_" + std::to_string(i);
 
-				std::vector<std::string> filePaths = std::vector<std::string>();
-
-				for (int k = 0; k < avg; k++)
-				{
-					auto start = std::chrono::high_resolution_clock::now();
+				auto start = std::chrono::high_resolution_clock::now();
 
-					filePaths.push_back(RunWavyNormalPerturbance(perturbanceFilePath, i, numOfRays, k, a, p));
+				ConvergenceResult result = RunUntilConverged([&](int k, double* sample) { return RunWavyNormalPerturbance(perturbanceFilePath, i, numOfRays, k, a, p, sample); }, convergence);
 
-					simIndex++;
+				j_perturbance[layerName] = result.ToJSON();
 
-					double percentComplete = ((double)simIndex / (double)totalRuns) * 100.0;
+				simIndex++;
 
-					auto end = std::chrono::high_resolution_clock::now();
+				double percentComplete = ((double)simIndex / (double)totalPoints) * 100.0;
 
-					double timeTakenMS = std::chrono::duration<double, std::milli>(end - start).count();
+				auto end = std::chrono::high_resolution_clock::now();
 
-					std::cout << "Completed Render : " << percentComplete << "%" << " (" << timeTakenMS << " ms)" << std::endl;
-				}
+				double timeTakenMS = std::chrono::duration<double, std::milli>(end - start).count();
 
-				j_perturbance[layerName] = filePaths;
+				std::cout << "Completed Render : " << percentComplete << "%" << " (" << result.Samples.size() << " Repeats, +- " << result.HalfWidth << ", " << timeTakenMS << " ms)" << std::endl;
 
 				std::cout << "Completed Layer Count: " << i << std::endl;
 			}
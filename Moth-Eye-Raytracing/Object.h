@@ -1,11 +1,15 @@
 #pragma once
-#include "Segment.h"
+#include "SegmentArray.h"
+#include "Material.h"
+#include "HitContext.h"
 #include <vector>
-#include <random>
+#include "RandomStream.h"
 #include <iostream>
 #include <nlohmann/json.hpp>
 #include "ObjectNode.h"
 #include <limits>
+#include <algorithm>
+#include <future>
 #include "ObjectBounds.h"
 using json = nlohmann::json;
 
@@ -19,77 +23,233 @@ class Object
 {
 public:
 
-	std::vector<Segment> Segments;
+	// Per-segment data used while building the BVH
+	struct BuildInput
+	{
+		std::vector<int> Order;
+
+		std::vector<ObjectBounds> SegmentBounds;
+
+		std::vector<Vec2> Centers;
+	};
+
+	SegmentArray Segments;
+
+	// Dispersion and roughness models, indexed by SegmentArray::Material
+	std::vector<Material> Materials;
 
 	std::string Type;
 
-	ObjectNode Root;
+	// Flattened BVH, node 0 is the root and leaves reference contiguous ranges of Segments
+	std::vector<ObjectNode> Nodes;
+
+	ObjectBounds Bounds;
 
 	const int MAX_DEPTH = 50;
 
-	Object() : Root()
+	// Traversal stack, deeper than MAX_DEPTH so it can never overflow
+	static const int STACK_SIZE = 64;
+
+	static const int SAH_BINS = 16;
+
+	// Below this many segments a subtree is always built on the calling thread
+	const int PARALLEL_BUILD_MIN_SEGMENTS = 1024;
+
+	// Ranges with at most this many segments become leaves, larger ones are always split
+	int LeafSize;
+
+	Object() : Bounds()
 	{
-		Segments = std::vector<Segment>();
+		Segments = SegmentArray();
+		Materials = std::vector<Material>();
+		Nodes = std::vector<ObjectNode>();
 		Type = "Object";
+		LeafSize = 4;
+	}
+
+	// Scenes own their objects and prototypes through Object*
+	virtual ~Object() = default;
+
+	// Returns the index to pass to AddSegment, segments of the same surface should share one material
+	int AddMaterial(std::function<double(double)> refractiveIndex, PerturbanceGenerator* generator)
+	{
+		Materials.emplace_back(refractiveIndex, generator);
+		return Materials.size() - 1;
+	}
+
+	void AddSegment(double x1, double y1, double x2, double y2, int material)
+	{
+		Segments.Add(x1, y1, x2, y2, material);
 	}
 
-	void AddSegment(double x1, double y1, double x2, double y2, std::function<double(double)> refractiveIndex, PerturbanceGenerator* generator)
+	double GetRefractiveIndex(int segment, double wavelength)
 	{
-		Segments.emplace_back(x1, y1, x2, y2, refractiveIndex, generator);
+		return Materials[Segments.Material[segment]].GetRefractiveIndex(wavelength);
+	}
+
+	// Left normal of the segment, rotated by its material's perturbance when perturb is set
+	Vec2 GetNormal(int segment, bool perturb = false)
+	{
+		if (!perturb)
+			return Segments.GetNormal(segment);
+
+		// The edge is rotated before normalizing, rotating the stored unit normal would round differently
+		Vec2 edge = Segments.GetEdge(segment);
+		Vec2 normal = Vec2(-edge.Y, edge.X).Rotate(Materials[Segments.Material[segment]].GetPerturbance());
+
+		normal.Normalize();
+		return normal;
 	}
 
-	void BVH()
+	// Hit point and sampled normal of a hit found by traversal, the normal is drawn once here and shared by every ray the
+	// event produces
+	virtual HitContext GetHitContext(RayHit& hit, Ray* ray)
 	{
-		for (Segment& segment : Segments)
+		HitContext context;
+		context.Segment = hit.SegmentHit;
+		context.Distance = hit.Distance;
+		context.Position = ray->GetIntersectionPosition(hit.Distance);
+
+		if (hit.SegmentHit < 0)
+			return context;
+
+		context.SurfaceMaterial = &Materials[Segments.Material[hit.SegmentHit]];
+		context.Normal = GetNormal(hit.SegmentHit, true);
+
+		if (ray->Direction.Dot(context.Normal) > 0)
+			context.Normal = context.Normal * -1.0;
+
+		context.IncidentCos = -context.Normal.Dot(ray->Direction);
+
+		return context;
+	}
+
+	void Reflect(HitContext& hit, Ray* ray)
+	{
+		Vec2 direction = ray->Direction;
+
+		ray->Origin = hit.Position;
+		ray->Direction = direction - (hit.Normal * 2.0 * direction.Dot(hit.Normal));
+	}
+
+	// Refracts into a medium of index n2
+	void Transmit(HitContext& hit, Ray* ray, double n2)
+	{
+		double eta = ray->CurrentMedium / n2;
+		double incidentSin = std::sqrt(std::max(0.0, 1.0 - hit.IncidentCos * hit.IncidentCos));
+
+		if (eta * incidentSin >= 1.0)
+			// Total internal reflection
+			return Reflect(hit, ray);
+
+		ray->Origin = hit.Position;
+		ray->Direction = Refract(ray->Direction, hit.Normal, eta, hit.IncidentCos);
+	}
+
+	virtual void BVH(int threadCount = 1)
+	{
+		Nodes.clear();
+		Bounds = ObjectBounds();
+
+		for (int i = 0; i < Segments.Size(); i++)
+			Bounds.GrowToInclude(Segments, i);
+
+		if (Segments.Empty())
+			return;
+
+		BuildInput input;
+		input.Order = std::vector<int>(Segments.Size());
+		input.SegmentBounds = std::vector<ObjectBounds>(Segments.Size());
+		input.Centers = std::vector<Vec2>(Segments.Size());
+
+		for (int i = 0; i < Segments.Size(); i++)
 		{
-			Root.Bounds.GrowToInclude(&segment);
-			Root.Segments.push_back(&segment);
+			input.Order[i] = i;
+			input.SegmentBounds[i].GrowToInclude(Segments, i);
+			input.Centers[i] = Vec2(Segments.GetCenterX(i), Segments.GetCenterY(i));
 		}
 
-		Split(Root, 0);
+		Nodes.reserve(2 * Segments.Size());
+
+		Split(Nodes, input, 0, Segments.Size(), 0, threadCount);
+
+		// Reorder the segments so every leaf covers a contiguous range
+		Segments.Reorder(input.Order);
 	}
 
-	void Split(ObjectNode& parent, int depth = 0)
+	// Builds the subtree over Order[start, end) into nodes in depth-first order using a binned SAH
+	void Split(std::vector<ObjectNode>& nodes, BuildInput& input, int start, int end, int depth, int threadCount)
 	{
+		int nodeIndex = nodes.size();
+		nodes.push_back(ObjectNode());
+
+		ObjectBounds bounds = ObjectBounds();
+		ObjectBounds centerBounds = ObjectBounds();
+
+		for (int i = start; i < end; i++)
+		{
+			bounds.GrowToInclude(input.SegmentBounds[input.Order[i]]);
+			centerBounds.GrowToInclude(input.Centers[input.Order[i]]);
+		}
+
+		int count = end - start;
+
+		nodes[nodeIndex].Bounds = bounds;
+		nodes[nodeIndex].Start = start;
+		nodes[nodeIndex].Count = count;
+
 		//Base Case
-		if (depth == MAX_DEPTH || parent.Segments.size() <= depth * 4)
+		if (count <= LeafSize || depth == MAX_DEPTH)
 			return;
 
-		bool isSplitX = parent.Bounds.LargestDimensionIsX();
-		double center = isSplitX ? parent.Bounds.GetCenterX() : parent.Bounds.GetCenterY();
+		int axis = 0;
+		int splitBin = 0;
 
-		std::vector<Segment*> leftSegments;
-		std::vector<Segment*> rightSegments;
+		if (!FindSplit(input, start, end, centerBounds, axis, splitBin))
+			return;
 
-		for (Segment* segment : parent.Segments)
-		{
-			bool isInLeftNode = parent.Bounds.IsInLeftNode(segment, isSplitX, center);
-			if (isInLeftNode)
-				leftSegments.push_back(segment);
-			else
-				rightSegments.push_back(segment);
-		}
+		int mid = std::partition(input.Order.begin() + start, input.Order.begin() + end, [&](int index)
+			{
+				return GetBin(input.Centers[index], centerBounds, axis) <= splitBin;
+			}) - input.Order.begin();
 
-		if (leftSegments.empty() || rightSegments.empty())
+		if (mid == start || mid == end)
 			return;
 
-		parent.LeftNode = new ObjectNode();
-		parent.RightNode = new ObjectNode();
+		nodes[nodeIndex].Count = 0;
 
-		for (Segment* segment : leftSegments)
+		if (threadCount > 1 && count >= PARALLEL_BUILD_MIN_SEGMENTS)
 		{
-			parent.LeftNode->Bounds.GrowToInclude(segment);
-			parent.LeftNode->Segments.push_back(segment);
-		}
+			// Right subtree goes into its own array and is spliced in after the left one
+			std::vector<ObjectNode> rightNodes;
+
+			std::future<void> right = std::async(std::launch::async, [&]()
+				{
+					Split(rightNodes, input, mid, end, depth + 1, threadCount / 2);
+				});
+
+			Split(nodes, input, start, mid, depth + 1, threadCount - threadCount / 2);
+
+			right.wait();
+
+			int offset = nodes.size();
 
-		for (Segment* segment : rightSegments)
+			for (ObjectNode& node : rightNodes)
+			{
+				if (!node.IsLeaf())
+					node.Start += offset;
+
+				nodes.push_back(node);
+			}
+
+			nodes[nodeIndex].Start = offset;
+		}
+		else
 		{
-			parent.RightNode->Bounds.GrowToInclude(segment);
-			parent.RightNode->Segments.push_back(segment);
+			Split(nodes, input, start, mid, depth + 1, 1);
+			nodes[nodeIndex].Start = nodes.size();
+			Split(nodes, input, mid, end, depth + 1, 1);
 		}
-
-		Split(*parent.LeftNode, depth + 1);
-		Split(*parent.RightNode, depth + 1);
 	}
 
 	//RayHit Intersect(Ray* ray)
@@ -109,104 +269,227 @@ public:
 	//	}
 	//
 	//	if (closestSegment == nullptr)
-	//		return RayHit(false, 0.0, nullptr);
+	//		return RayHit(false, 0.0, -1);
 	//	else
 	//		return RayHit(true, minT, closestSegment);
 	//}
 
-	//Create a Function to Get Closest Corner of Bounds
-
-	double ShortestDistanceSqr(Ray* ray)
+	// Closest hit, visiting the nearer child first and skipping any node that starts past the best hit so far
+	virtual RayHit Intersect(Ray* ray, int* nodeVisits = nullptr)
 	{
-		double shortestDistance = std::numeric_limits<double>::infinity();
+		if (Nodes.empty())
+			return RayHit(false, 0.0, -1);
+
+		double minT = INFINITY;
+		int closestSegment = -1;
+
+		int stack[STACK_SIZE];
+		double stackEnter[STACK_SIZE];
+		int stackSize = 0;
+
+		double tEnter, tExit;
 
-		for (Vec2 corner : Root.Bounds.Corners)
+		if (!Nodes[0].Bounds.Intersects(ray, tEnter, tExit))
+			return RayHit(false, 0.0, -1);
+
+		stack[stackSize] = 0;
+		stackEnter[stackSize++] = tEnter;
+
+		while (stackSize > 0)
 		{
-			Vec2 toCorner = corner - ray->Origin;
-			double projectionLength = toCorner.Dot(ray->Direction);
-			Vec2 projectionPoint = ray->Origin + ray->Direction * projectionLength;
-			double distance = (corner - projectionPoint).MagnitudeSquared();
+			stackSize--;
+
+			if (stackEnter[stackSize] > minT)
+				continue;
+
+			int nodeIndex = stack[stackSize];
+			ObjectNode& node = Nodes[nodeIndex];
+
+			if (nodeVisits != nullptr)
+				(*nodeVisits)++;
+
+			if (node.IsLeaf())
+			{
+				for (int i = node.Start; i < node.Start + node.Count; i++)
+				{
+					RayHit hit = Segments.Intersect(i, ray);
+
+					if (hit.Hit && hit.Distance < minT)
+					{
+						minT = hit.Distance;
+						closestSegment = i;
+					}
+				}
 
-			if (distance < shortestDistance)
-				shortestDistance = distance;
+				continue;
+			}
+
+			int left = nodeIndex + 1;
+			int right = node.Start;
+
+			double leftEnter, leftExit, rightEnter, rightExit;
+			bool hitLeft = Nodes[left].Bounds.Intersects(ray, leftEnter, leftExit) && leftEnter <= minT;
+			bool hitRight = Nodes[right].Bounds.Intersects(ray, rightEnter, rightExit) && rightEnter <= minT;
+
+			// Farther child goes on the stack first so the nearer one is popped next
+			if (hitLeft && hitRight && leftEnter > rightEnter)
+			{
+				std::swap(left, right);
+				std::swap(leftEnter, rightEnter);
+			}
+
+			if (hitRight)
+			{
+				stack[stackSize] = right;
+				stackEnter[stackSize++] = rightEnter;
+			}
+
+			if (hitLeft)
+			{
+				stack[stackSize] = left;
+				stackEnter[stackSize++] = leftEnter;
+			}
 		}
 
-		return shortestDistance;
+		if (closestSegment < 0)
+			return RayHit(false, 0.0, -1);
+
+		return RayHit(true, minT, closestSegment);
 	}
 
-	RayHit Intersect(Ray* ray)
+	// Appends the resulting rays to output, which the caller owns and reuses, so interactions don't allocate
+	// bundles is the pool the ray's spectral bundle is in, the bundles of the resulting rays are added to it
+	virtual void InteractWithRay(HitContext& hit, Ray* ray, std::vector<Ray>& output, std::vector<SpectralBundle>& bundles)
 	{
-		return IntersectNode(&Root, ray);
+		if (ray->Bundle >= 0)
+		{
+			InteractWithSpectralRay(hit, ray, output, bundles);
+			return;
+		}
+
+		double n2 = hit.SurfaceMaterial->GetRefractiveIndex(ray->Wavelength);
+		FresnelCoeffs fresnel = GetFresnelCoefficients(ray->CurrentMedium, n2, hit.IncidentCos);
+
+		Ray cloneRay = ray->Clone();
+
+		ray->Power *= fresnel.Reflectance;
+		cloneRay.Power *= fresnel.Transmittance;
+
+		Reflect(hit, ray);
+		output.push_back(*ray);
+
+		Transmit(hit, &cloneRay, n2);
+		cloneRay.CurrentMedium = n2;
+		cloneRay.CurrentBounce = 0;
+		output.push_back(cloneRay);
 	}
 
-	RayHit IntersectNode(ObjectNode* node, Ray* ray)
+	// Every wavelength of the bundle sees the hit's normal and shares the reflected ray, Fresnel and refraction are
+	// per wavelength. The transmitted bundle follows the hero, wavelengths dispersion turns away from it leave in new bundles
+	// of the wavelengths that still travel together
+	// Appends the reflected ray, the transmitted bundle, then the bundles split off it, each with a new bundle in the pool
+	void InteractWithSpectralRay(HitContext& hit, Ray* ray, std::vector<Ray>& output, std::vector<SpectralBundle>& bundles)
 	{
-		if (node == nullptr)
-			return RayHit(false, 0.0, nullptr);
+		Vec2 position = hit.Position;
+		Vec2 normal = hit.Normal;
+		Vec2 direction = ray->Direction;
+
+		double incidentCos = hit.IncidentCos;
+
+		// Copied, adding the bundles of the resulting rays can move the pool
+		SpectralBundle incoming = bundles[ray->Bundle];
+
+		Ray reflectedBundle = *ray;
+		reflectedBundle.Origin = position;
+		reflectedBundle.Direction = direction - (normal * 2.0 * direction.Dot(normal));
+		reflectedBundle.Bundle = bundles.size();
+		bundles.push_back(incoming);
 
-		if (!node->Bounds.Intersects(ray))
-			return RayHit(false, 0.0, nullptr);
+		Ray transmittedBundle = ray->Clone();
+		transmittedBundle.Origin = position;
+		transmittedBundle.Direction = reflectedBundle.Direction;
+		transmittedBundle.CurrentBounce = 0;
+		transmittedBundle.Bundle = bundles.size();
+		bundles.push_back(SpectralBundle());
 
-		if (node->LeftNode == nullptr && node->RightNode == nullptr)
+		size_t first = output.size();
+		output.push_back(reflectedBundle);
+		output.push_back(transmittedBundle);
+
+		bool heroTransmits = false;
+		double splitCos = std::cos(DISPERSION_SPLIT_ANGLE);
+
+		for (int k = 0; k < incoming.Count; k++)
 		{
-			double minT = INFINITY;
-			Segment* closestSegment = nullptr;
+			double n1 = incoming.Media[k];
+			double n2 = hit.SurfaceMaterial->GetRefractiveIndex(incoming.Wavelengths[k]);
+
+			FresnelCoeffs fresnel = GetFresnelCoefficients(n1, n2, incidentCos);
+
+			bundles[reflectedBundle.Bundle].Powers[k] *= fresnel.Reflectance;
+
+			double power = incoming.Powers[k] * fresnel.Transmittance;
+			Vec2 refracted = fresnel.Transmittance > 0.0 ? Refract(direction, normal, n1 / n2, incidentCos) : transmittedBundle.Direction;
 
-			for (Segment* segment : node->Segments)
+			if (k == 0 && fresnel.Transmittance > 0.0)
 			{
-				RayHit hit = segment->Intersect(ray);
+				transmittedBundle.Direction = refracted;
+				heroTransmits = true;
+			}
 
-				if (hit.Hit && hit.Distance < minT)
-				{
-					minT = hit.Distance;
-					closestSegment = segment;
-				}
+			// The hero, and wavelengths that carry nothing, always stay in the bundle
+			if (k == 0 || fresnel.Transmittance <= 0.0 || (heroTransmits && refracted.Dot(transmittedBundle.Direction) >= splitCos))
+			{
+				bundles[transmittedBundle.Bundle].Add(incoming.Wavelengths[k], power, n2);
+				continue;
 			}
 
-			if (closestSegment == nullptr)
-				return RayHit(false, 0.0, nullptr);
-			else
-				return RayHit(true, minT, closestSegment);
-		}
+			size_t target = first + 2;
 
-		RayHit leftHit = IntersectNode(node->LeftNode, ray);
-		RayHit rightHit = IntersectNode(node->RightNode, ray);
+			while (target < output.size() && refracted.Dot(output[target].Direction) < splitCos)
+				target++;
 
-		if (leftHit.Hit && rightHit.Hit)
-		{
-			if (leftHit.Distance < rightHit.Distance)
-				return leftHit;
-			else
-				return rightHit;
+			if (target == output.size())
+			{
+				Ray split = transmittedBundle;
+				split.Direction = refracted;
+				split.Bundle = bundles.size();
+				bundles.push_back(SpectralBundle());
+				output.push_back(split);
+			}
+
+			bundles[output[target].Bundle].Add(incoming.Wavelengths[k], power, n2);
 		}
-		else if (leftHit.Hit)
-			return leftHit;
-		else if (rightHit.Hit)
-			return rightHit;
-		else
-			return RayHit(false, 0.0, nullptr);
-	}
 
-	virtual std::vector<Ray> InteractWithRay(Segment* segment, Ray* ray)
-	{
-		FresnelCoeffs fresnel = GetFresnelCoefficients(segment, ray);
+		output[first] = reflectedBundle;
+		output[first + 1] = transmittedBundle;
 
-		Ray cloneRay = ray->Clone();
+		// Every ray follows its first wavelength, one left with only that wavelength is monochromatic again
+		for (size_t r = first; r < output.size(); r++)
+		{
+			Ray& result = output[r];
+			SpectralBundle& spectrum = bundles[result.Bundle];
 
-		std::vector<Ray> resultingRays;
+			result.Power = spectrum.TotalPower();
+			result.Wavelength = spectrum.Wavelengths[0];
+			result.CurrentMedium = spectrum.Media[0];
 
-		ray->Power *= fresnel.Reflectance;
-		cloneRay.Power *= fresnel.Transmittance;
+			if (spectrum.Count <= 1)
+				result.Bundle = -1;
+		}
+	}
 
-		segment->Reflect(ray);
-		resultingRays.push_back(*ray);
+	// Snell's law with incidentCos against the normal facing the incoming direction, only valid below the critical angle
+	Vec2 Refract(Vec2 direction, Vec2 normal, double eta, double incidentCos)
+	{
+		double incidentSin = std::sqrt(std::max(0.0, 1.0 - incidentCos * incidentCos));
+		double transmitSin = eta * incidentSin;
+		double transmitCos = std::sqrt(std::max(0.0, 1.0 - transmitSin * transmitSin));
 
-		segment->Transmit(&cloneRay);
-		cloneRay.CurrentMedium = segment->GetRefractiveIndex(cloneRay.Wavelength);
-		cloneRay.CurrentBounce = 0;
-		resultingRays.push_back(cloneRay);
+		Vec2 refracted = direction * eta + normal * (eta * incidentCos - transmitCos);
+		refracted.Normalize();
 
-		return resultingRays;
+		return refracted;
 	}
 
 	std::vector<double> linspace(double start, double end, int num) {
@@ -229,36 +512,100 @@ public:
 		json j;
 		j["Type"] = Type;
 		
-		if (!Segments.empty())
+		if (!Segments.Empty())
 		{
-			j["SegmentCount"] = Segments.size();
+			j["SegmentCount"] = Segments.Size();
 			j["Segments"] = json::array();
 
-			for (Segment& segment : Segments)
-				j["Segments"].push_back(segment.ToJSON());
+			for (int i = 0; i < Segments.Size(); i++)
+			{
+				json segment = Segments.ToJSON(i);
+				segment["RefractiveIndex"] = GetRefractiveIndex(i, 500);
+				j["Segments"].push_back(segment);
+			}
 		}
 		
 		return j;
 	}
 
 protected:
-	FresnelCoeffs GetFresnelCoefficients(Segment* segment, Ray* ray)
+	int GetBin(Vec2& center, ObjectBounds& centerBounds, int axis)
 	{
-		double n1 = ray->CurrentMedium;
-		double n2 = segment->GetRefractiveIndex(ray->Wavelength);
+		double min = axis == 0 ? centerBounds.MinBound.X : centerBounds.MinBound.Y;
+		double max = axis == 0 ? centerBounds.MaxBound.X : centerBounds.MaxBound.Y;
+		double value = axis == 0 ? center.X : center.Y;
 
-		Vec2 normal = segment->GetNormal(true, true);
+		int bin = (int)(SAH_BINS * (value - min) / (max - min));
 
-		//ray->Direction.Normalize();
-		
-		double incidentCos = -normal.Dot(ray->Direction);
+		return std::max(0, std::min(SAH_BINS - 1, bin));
+	}
 
-		if (incidentCos < 0)
+	// Sweeps the bins on both axes and returns the split with the lowest perimeter weighted cost
+	bool FindSplit(BuildInput& input, int start, int end, ObjectBounds& centerBounds, int& bestAxis, int& bestBin)
+	{
+		bool found = false;
+		double bestCost = INFINITY;
+
+		for (int axis = 0; axis < 2; axis++)
 		{
-			normal = normal * -1;
-			incidentCos = -incidentCos;
+			double extent = axis == 0 ? centerBounds.MaxBound.X - centerBounds.MinBound.X : centerBounds.MaxBound.Y - centerBounds.MinBound.Y;
+
+			if (extent <= EPSILON)
+				continue;
+
+			ObjectBounds binBounds[SAH_BINS];
+			int binCounts[SAH_BINS] = {};
+
+			for (int i = start; i < end; i++)
+			{
+				int index = input.Order[i];
+				int bin = GetBin(input.Centers[index], centerBounds, axis);
+
+				binBounds[bin].GrowToInclude(input.SegmentBounds[index]);
+				binCounts[bin]++;
+			}
+
+			// Right to left sweep stores the cost of everything past each bin
+			double rightCost[SAH_BINS] = {};
+			ObjectBounds rightBounds = ObjectBounds();
+			int rightCount = 0;
+
+			for (int bin = SAH_BINS - 1; bin > 0; bin--)
+			{
+				rightBounds.GrowToInclude(binBounds[bin]);
+				rightCount += binCounts[bin];
+				rightCost[bin - 1] = rightCount * rightBounds.GetPerimeter();
+			}
+
+			ObjectBounds leftBounds = ObjectBounds();
+			int leftCount = 0;
+
+			for (int bin = 0; bin < SAH_BINS - 1; bin++)
+			{
+				leftBounds.GrowToInclude(binBounds[bin]);
+				leftCount += binCounts[bin];
+
+				if (leftCount == 0 || leftCount == end - start)
+					continue;
+
+				double cost = leftCount * leftBounds.GetPerimeter() + rightCost[bin];
+
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = bin;
+					found = true;
+				}
+			}
 		}
 
+		return found;
+	}
+
+	// incidentCos against the normal facing the incoming ray
+	FresnelCoeffs GetFresnelCoefficients(double n1, double n2, double incidentCos)
+	{
 		double incidentSin = std::sqrt(std::max(0.0, 1.0 - incidentCos * incidentCos));
 
 		double transmitSin = (n1 / n2) * incidentSin;
@@ -314,9 +661,6 @@ protected:
 	}
 
 	int randomInt(int min, int max) {
-		static std::random_device rd;
-		static std::mt19937 gen(rd());
-		std::uniform_int_distribution<int> dist(min, max);
-		return dist(gen);
+		return RandomStream::Current().Integer(min, max);
 	}
 };
\ No newline at end of file
@@ -1,52 +1,57 @@
 #pragma once
-#include "Segment.h"
-#include "ConstantPerturbance.h"
+#include "SegmentArray.h"
+#include <limits>
+#include <algorithm>
 class ObjectBounds
 {
 public:
 
-	ConstantPerturbance DefaultPerturbance;
-
 	Vec2 MinBound;
 
 	Vec2 MaxBound;
 
-	Segment Edges[4];
-
-	Vec2 Corners[4];
-
 	ObjectBounds()
 		: MinBound(std::numeric_limits<double>::max(),
 			std::numeric_limits<double>::max()),
 		MaxBound(std::numeric_limits<double>::lowest(),
-			std::numeric_limits<double>::lowest()),
-		DefaultPerturbance(0),
-		Edges{
-			Segment(0,0,0,0, [](double) { return 1.0; }, &DefaultPerturbance),
-			Segment(0,0,0,0, [](double) { return 1.0; }, &DefaultPerturbance),
-			Segment(0,0,0,0, [](double) { return 1.0; }, &DefaultPerturbance),
-			Segment(0,0,0,0, [](double) { return 1.0; }, &DefaultPerturbance)
-			}
+			std::numeric_limits<double>::lowest())
+	{
+	}
+
+	void GrowToInclude(const SegmentArray& segments, int index)
+	{
+		MinBound.X = std::min(MinBound.X, std::min(segments.AX[index], segments.BX[index]));
+		MinBound.Y = std::min(MinBound.Y, std::min(segments.AY[index], segments.BY[index]));
+
+		MaxBound.X = std::max(MaxBound.X, std::max(segments.AX[index], segments.BX[index]));
+		MaxBound.Y = std::max(MaxBound.Y, std::max(segments.AY[index], segments.BY[index]));
+	}
+
+	void GrowToInclude(const ObjectBounds& bounds)
 	{
+		MinBound.X = std::min(MinBound.X, bounds.MinBound.X);
+		MinBound.Y = std::min(MinBound.Y, bounds.MinBound.Y);
+
+		MaxBound.X = std::max(MaxBound.X, bounds.MaxBound.X);
+		MaxBound.Y = std::max(MaxBound.Y, bounds.MaxBound.Y);
 	}
 
-	void GrowToInclude(Segment* segment)
+	void GrowToInclude(const Vec2& point)
 	{
-		MinBound.X = std::min(MinBound.X, std::min(segment->A.X, segment->B.X));
-		MinBound.Y = std::min(MinBound.Y, std::min(segment->A.Y, segment->B.Y));
+		MinBound.X = std::min(MinBound.X, point.X);
+		MinBound.Y = std::min(MinBound.Y, point.Y);
 
-		MaxBound.X = std::max(MaxBound.X, std::max(segment->A.X, segment->B.X));
-		MaxBound.Y = std::max(MaxBound.Y, std::max(segment->A.Y, segment->B.Y));
+		MaxBound.X = std::max(MaxBound.X, point.X);
+		MaxBound.Y = std::max(MaxBound.Y, point.Y);
+	}
 
-		Edges[0] = Segment(MinBound.X, MinBound.Y, MaxBound.X, MinBound.Y, [](double) {return 1.0; }, &DefaultPerturbance);
-		Edges[1] = Segment(MaxBound.X, MinBound.Y, MaxBound.X, MaxBound.Y, [](double) {return 1.0; }, &DefaultPerturbance);
-		Edges[2] = Segment(MaxBound.X, MaxBound.Y, MinBound.X, MaxBound.Y, [](double) {return 1.0; }, &DefaultPerturbance);
-		Edges[3] = Segment(MinBound.X, MaxBound.Y, MinBound.X, MinBound.Y, [](double) {return 1.0; }, &DefaultPerturbance);
+	// 2D equivalent of the surface area used by the SAH
+	double GetPerimeter()
+	{
+		if (MaxBound.X < MinBound.X || MaxBound.Y < MinBound.Y)
+			return 0.0;
 
-		Corners[0] = Vec2(MinBound.X, MinBound.Y);
-		Corners[1] = Vec2(MaxBound.X, MinBound.Y);
-		Corners[2] = Vec2(MaxBound.X, MaxBound.Y);
-		Corners[3] = Vec2(MinBound.X, MaxBound.Y);
+		return 2.0 * ((MaxBound.X - MinBound.X) + (MaxBound.Y - MinBound.Y));
 	}
 
 	bool LargestDimensionIsX()
@@ -67,33 +72,22 @@ public:
 		return 0.5 * (MinBound.Y + MaxBound.Y);
 	}
 
-	bool IsInLeftNode(Segment* segment, bool xLargestDim, double center)
+	// Slab test, returns the parametric range [tEnter, tExit] the ray spends inside the box
+	bool Intersects(Ray* ray, double& tEnter, double& tExit)
 	{
-		if (xLargestDim)
-			return segment->GetCenterX() <= center;
-		else
-			return segment->GetCenterY() <= center;
+		tEnter = 0.0;
+		tExit = INFINITY;
+
+		if (!IntersectSlab(ray->Origin.X, ray->Direction.X, MinBound.X, MaxBound.X, tEnter, tExit))
+			return false;
+
+		return IntersectSlab(ray->Origin.Y, ray->Direction.Y, MinBound.Y, MaxBound.Y, tEnter, tExit);
 	}
 
 	bool Intersects(Ray* ray)
 	{
-		RayHit hit1 = Edges[0].Intersect(ray);
-		if (hit1.Hit)
-			return true;
-
-		RayHit hit2 = Edges[1].Intersect(ray);
-		if (hit2.Hit)
-			return true;
-
-		RayHit hit3 = Edges[2].Intersect(ray);
-		if (hit3.Hit)
-			return true;
-
-		RayHit hit4 = Edges[3].Intersect(ray);
-		if (hit4.Hit)
-			return true;
-
-		return false;
+		double tEnter, tExit;
+		return Intersects(ray, tEnter, tExit);
 	}
 
 	Vec2 GetCorner(int index)
@@ -103,7 +97,37 @@ public:
 		// 2: Top-Right
 		// 3: Top-Left
 
-		return Corners[index];
+		switch (index)
+		{
+		case 0:
+			return Vec2(MinBound.X, MinBound.Y);
+		case 1:
+			return Vec2(MaxBound.X, MinBound.Y);
+		case 2:
+			return Vec2(MaxBound.X, MaxBound.Y);
+		default:
+			return Vec2(MinBound.X, MaxBound.Y);
+		}
 	}
-};
 
+private:
+
+	static bool IntersectSlab(double origin, double direction, double min, double max, double& tEnter, double& tExit)
+	{
+		if (std::abs(direction) <= EPSILON)
+			// Parallel to the slab, only inside if the origin is
+			return origin >= min && origin <= max;
+
+		double inverse = 1.0 / direction;
+		double t1 = (min - origin) * inverse;
+		double t2 = (max - origin) * inverse;
+
+		if (t1 > t2)
+			std::swap(t1, t2);
+
+		tEnter = std::max(tEnter, t1);
+		tExit = std::min(tExit, t2);
+
+		return tEnter <= tExit;
+	}
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include "Object.h"
+#include "Vec2.h"
+// Translated copy of a shared prototype Object, rays are moved into prototype space to be intersected and interacted with
+// The Scene builds each distinct prototype once, Targets should not be instanced since their tallies live on the prototype
+class ObjectInstance : public Object
+{
+public:
+
+	// Not owned, Scene::AddPrototype hands it to the Scene
+	Object* Prototype;
+
+	Vec2 Translation;
+
+	// Power and rays that hit this instance, merged from the bake workers
+	double HitPower;
+
+	double HitRays;
+
+	int InstanceIndex;
+
+	ObjectInstance(Object* prototype, double x, double y) : Object(), Translation(x, y)
+	{
+		Type = "Instance";
+
+		this->Prototype = prototype;
+		this->HitPower = 0.0;
+		this->HitRays = 0.0;
+		this->InstanceIndex = -1;
+	}
+
+	// Prototype must already be built, the instance only needs its bounds moved
+	void BVH(int /*threadCount*/ = 1) override
+	{
+		Nodes.clear();
+
+		Bounds = ObjectBounds();
+
+		if (Prototype->Nodes.empty())
+			return;
+
+		Bounds.GrowToInclude(Prototype->Bounds.MinBound + Translation);
+		Bounds.GrowToInclude(Prototype->Bounds.MaxBound + Translation);
+
+		ObjectNode root = ObjectNode();
+		root.Bounds = Bounds;
+		Nodes.push_back(root);
+	}
+
+	// Translation keeps distances, so the prototype's hit distance is used as is
+	RayHit Intersect(Ray* ray, int* nodeVisits = nullptr) override
+	{
+		Ray localRay = *ray;
+		localRay.Origin -= Translation;
+
+		return Prototype->Intersect(&localRay, nodeVisits);
+	}
+
+	// Made from the ray in prototype space, so the prototype interacts with a context in its own space
+	HitContext GetHitContext(RayHit& hit, Ray* ray) override
+	{
+		Ray localRay = *ray;
+		localRay.Origin -= Translation;
+
+		return Prototype->GetHitContext(hit, &localRay);
+	}
+
+	void InteractWithRay(HitContext& hit, Ray* ray, std::vector<Ray>& output, std::vector<SpectralBundle>& bundles) override
+	{
+		ray->Origin -= Translation;
+
+		size_t first = output.size();
+		Prototype->InteractWithRay(hit, ray, output, bundles);
+
+		ray->Origin += Translation;
+
+		for (size_t r = first; r < output.size(); r++)
+			output[r].Origin += Translation;
+	}
+
+	json ToJSON() override
+	{
+		json j = Prototype->ToJSON();
+		j["Translation"] = { Translation.X, Translation.Y };
+		j["HitPower"] = this->HitPower;
+		j["HitRays"] = this->HitRays;
+
+		if (j.count("Center") > 0)
+			j["Center"] = { j["Center"][0].get<double>() + Translation.X, j["Center"][1].get<double>() + Translation.Y };
+
+		if (j.count("Segments") > 0)
+		{
+			for (json& segment : j["Segments"])
+			{
+				for (std::string point : { "A", "B" })
+				{
+					segment[point]["X"] = segment[point]["X"].get<double>() + Translation.X;
+					segment[point]["Y"] = segment[point]["Y"].get<double>() + Translation.Y;
+				}
+			}
+		}
+
+		return j;
+	}
+};
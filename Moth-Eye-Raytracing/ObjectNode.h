@@ -1,31 +1,27 @@
 #pragma once
-#include "Segment.h"
 #include "ObjectBounds.h"
+// Compact node of an Object's flattened BVH, stored contiguously in Object::Nodes
 class ObjectNode
 {
 public:
 
-	ObjectNode* LeftNode;
-
-	ObjectNode* RightNode;
+	ObjectBounds Bounds;
 
-	std::vector<Segment*> Segments;
+	// Interior : index of the right child, the left child is always stored right after this node
+	// Leaf : index of the first segment in Object::Segments
+	int Start;
 
-	ObjectBounds Bounds;
+	// Number of segments in a leaf, 0 for interior nodes
+	int Count;
 
-	ObjectNode()
+	ObjectNode() : Bounds()
 	{
-		Segments = std::vector<Segment*>();
-		LeftNode = nullptr;
-		RightNode = nullptr;
-		Bounds = ObjectBounds();
+		Start = 0;
+		Count = 0;
 	}
 
-	~ObjectNode()
+	bool IsLeaf()
 	{
-		if (LeftNode != nullptr)
-			delete LeftNode;
-		if (RightNode != nullptr)
-			delete RightNode;
+		return Count > 0;
 	}
-};
\ No newline at end of file
+};
@@ -12,23 +12,24 @@ public:
 	{
 	}
 
-	std::vector<Ray> GenerateRays() override
+	std::vector<Ray> GenerateRays(std::vector<SpectralBundle>& bundles) override
 	{
 		std::vector<Ray> rays = std::vector<Ray>();
 		rays.reserve(this->NumberOfRays);
 
 		double pi2 = 2 * 3.14159265358979323846;
 
-		WavelengthGenerator& wg = *this->WavelengthGen;
-
 		for (int i = 0; i < this->NumberOfRays; i++)
 		{
+			RandomStream::Current().Select(i);
+
 			double angle = pi2*(double(i) / double(this->NumberOfRays));
 			double dx = cos(angle);
 			double dy = sin(angle);
 
-			Ray ray = Ray(this->Origin.X, this->Origin.Y, dx, dy, wg.GenerateWavelength());
+			Ray ray = Ray(this->Origin.X, this->Origin.Y, dx, dy);
 			ray.CurrentMedium = this->CurrentMedium;
+			this->AssignWavelengths(ray, bundles);
 
 			rays.push_back(ray);
 		}
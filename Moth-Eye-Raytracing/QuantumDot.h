@@ -2,6 +2,8 @@
 #include "Object.h"
 #include "Vec2.h"
 #include "ConstantPerturbance.h"
+#include "RandomStream.h"
+// Analytic circle, no segments are stored and hits are solved directly against the circle
 class QuantumDot : public Object
 {
 public:
@@ -12,40 +14,117 @@ public:
 
 	double Radius;
 
-	QuantumDot(double x, double y, double radius, int resolution) : Object(), Center(x, y), Radius(radius), PerturbanceGen(0)
+	// Only used to tessellate the circle for the saved geometry
+	int Resolution;
+
+	QuantumDot(double x, double y, double radius, int resolution) : Object(), PerturbanceGen(0), Center(x, y), Radius(radius)
 	{
 		Type = "QuantumDot";
 
-		std::vector<double> theta = linspace(0.0, 2 * 3.14159265358979323846, resolution);
+		this->Resolution = resolution;
+	}
 
-		for (int i = 0; i < resolution; i++)
-		{
-			double x1 = this->Center.X + radius * cos(theta[i]);
-			double y1 = this->Center.Y + radius * sin(theta[i]);
+	// Bounds of the circle as a single node so the scene BVH can place it
+	void BVH(int /*threadCount*/ = 1) override
+	{
+		Nodes.clear();
 
-			double x2 = this->Center.X + radius * cos(theta[(i + 1) % resolution]);
-			double y2 = this->Center.Y + radius * sin(theta[(i + 1) % resolution]);
+		Bounds = ObjectBounds();
+		Bounds.GrowToInclude(Vec2(Center.X - Radius, Center.Y - Radius));
+		Bounds.GrowToInclude(Vec2(Center.X + Radius, Center.Y + Radius));
 
-			this->AddSegment(x1, y1, x2, y2, [](double) {return 1.0; }, &PerturbanceGen);
-		}
+		ObjectNode root = ObjectNode();
+		root.Bounds = Bounds;
+		Nodes.push_back(root);
 	}
 
-	std::vector<Ray> InteractWithRay(Segment* segment, Ray* ray) override
+	// Nearest root of |Origin + t * Direction - Center| = Radius that is at least EPSILON along the ray
+	RayHit Intersect(Ray* ray, int* nodeVisits = nullptr) override
 	{
-		int randInt = randomInt(0, this->Segments.size() - 1);
+		if (nodeVisits != nullptr)
+			(*nodeVisits)++;
+
+		double offsetX = ray->Origin.X - Center.X;
+		double offsetY = ray->Origin.Y - Center.Y;
+
+		double a = ray->Direction.X * ray->Direction.X + ray->Direction.Y * ray->Direction.Y;
+		double b = ray->Direction.X * offsetX + ray->Direction.Y * offsetY;
+		double c = offsetX * offsetX + offsetY * offsetY - Radius * Radius;
+
+		double discriminant = b * b - a * c;
+
+		if (discriminant < 0.0 || a <= EPSILON)
+			return RayHit(false, 0.0, -1);
 
-		Segment randomSegment = this->Segments[randInt];
+		double root = sqrt(discriminant);
+		double t = (-b - root) / a;
 
-		Vec2 normal = randomSegment.GetNormal();
+		if (t < EPSILON)
+			t = (-b + root) / a;
+
+		if (t < EPSILON)
+			return RayHit(false, 0.0, -1);
+
+		return RayHit(true, t, -1);
+	}
+
+	Vec2 GetNormal(Vec2 position)
+	{
+		Vec2 normal = Vec2(position.X - Center.X, position.Y - Center.Y);
+		normal.Normalize();
+		return normal;
+	}
+
+	// Absorbs the ray and re-emits it radially outwards in a uniformly random direction
+	void InteractWithRay(HitContext&, Ray* ray, std::vector<Ray>& output, std::vector<SpectralBundle>&) override
+	{
+		double angle = randomAngle();
+
+		Vec2 normal = Vec2(cos(angle), sin(angle));
 		Vec2 newOrigin = this->Center + normal * this->Radius * 1.1;
 
 		ray->Origin = newOrigin;
 		ray->Direction = normal;
 		//ray->CurrentBounce = 0;
 
-		std::vector<Ray> rays = std::vector<Ray>();
-		rays.push_back(*ray);
+		output.push_back(*ray);
+	}
+
+	json ToJSON() override
+	{
+		json j = Object::ToJSON();
+		j["Center"] = { this->Center.X, this->Center.Y };
+		j["Radius"] = this->Radius;
+
+		// Tessellated outline so the geometry renderers can keep drawing segments, the last one closes the circle
+		double step = 2 * 3.14159265358979323846 / this->Resolution;
+
+		j["SegmentCount"] = this->Resolution;
+		j["Segments"] = json::array();
+
+		for (int i = 0; i < this->Resolution; i++)
+		{
+			double x1 = this->Center.X + this->Radius * cos(i * step);
+			double y1 = this->Center.Y + this->Radius * sin(i * step);
+
+			double x2 = this->Center.X + this->Radius * cos(((i + 1) % this->Resolution) * step);
+			double y2 = this->Center.Y + this->Radius * sin(((i + 1) % this->Resolution) * step);
+
+			json segment;
+			segment["A"] = Vec2(x1, y1).ToJSON();
+			segment["B"] = Vec2(x2, y2).ToJSON();
+			segment["RefractiveIndex"] = 1.0;
+
+			j["Segments"].push_back(segment);
+		}
+
+		return j;
+	}
+
+private:
 
-		return rays;
+	double randomAngle()
+	{
+		return RandomStream::Current().Uniform() * 2 * 3.14159265358979323846;
 	}
-};
\ No newline at end of file
+};
@@ -0,0 +1,235 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <vector>
+// Philox4x32-10 counter-based generator (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3")
+// A draw is a pure function of (seed, ray, event, draw number), so results do not depend on which thread or in which order rays are traced
+// In quasi-random mode the same draw of every ray is instead one coordinate of an Owen scrambled Sobol sequence indexed by the ray
+class RandomStream
+{
+public:
+
+	// Source i generates its rays under Branch(SOURCE_EVENT, i), ray events are hashes of their place in the split tree
+	static const uint64_t SOURCE_EVENT = ~0ULL;
+
+	// Ray index used by a source for draws shared by all of its rays
+	static const uint32_t SOURCE_RAY = ~0U;
+
+	// Draws of an event are grouped into jointly stratified Sobol points of this many dimensions
+	static const int SOBOL_DIMENSIONS = 4;
+
+	uint64_t Seed;
+
+	uint32_t RayIndex;
+
+	uint64_t Event;
+
+	uint32_t Draw;
+
+	bool QuasiRandom;
+
+	RandomStream(uint64_t seed = 0, uint32_t rayIndex = 0, uint64_t event = 0, bool quasiRandom = false)
+	{
+		Begin(seed, rayIndex, event, quasiRandom);
+	}
+
+	void Begin(uint64_t seed, uint32_t rayIndex, uint64_t event, bool quasiRandom = false)
+	{
+		this->Seed = seed;
+		this->RayIndex = rayIndex;
+		this->Event = event;
+		this->QuasiRandom = quasiRandom;
+		this->Draw = 0;
+		this->CachedBlock = ~0U;
+	}
+
+	// Moves to another ray of the same event, used by sources to give each generated ray its own draws
+	void Select(uint32_t rayIndex)
+	{
+		this->RayIndex = rayIndex;
+		this->Draw = 0;
+		this->CachedBlock = ~0U;
+	}
+
+	// Uniform in [0, 1), 53 bits from Philox (two draws per block) or 32 bits from the scrambled Sobol sequence
+	double Uniform()
+	{
+		if (this->QuasiRandom)
+			return SobolUniform();
+
+		uint32_t block = this->Draw / 2;
+		uint32_t half = this->Draw % 2;
+
+		if (block != this->CachedBlock)
+		{
+			uint32_t counter[4] = { block, (uint32_t)this->Event, (uint32_t)(this->Event >> 32), this->RayIndex };
+			uint32_t key[2] = { (uint32_t)this->Seed, (uint32_t)(this->Seed >> 32) };
+
+			Philox(counter, key, this->Block);
+			this->CachedBlock = block;
+		}
+
+		this->Draw++;
+
+		uint64_t high = this->Block[half * 2] >> 5;
+		uint64_t low = this->Block[half * 2 + 1] >> 6;
+
+		return (high * 67108864.0 + low) * (1.0 / 9007199254740992.0);
+	}
+
+	// Box-Muller, one normal per two uniforms so the draw count stays fixed
+	double Normal(double mu, double sigma)
+	{
+		double u1 = 1.0 - Uniform();
+		double u2 = Uniform();
+
+		return mu + sigma * std::sqrt(-2.0 * std::log(u1)) * std::cos(2 * 3.14159265358979323846 * u2);
+	}
+
+	// Uniform in [min, max]
+	int Integer(int min, int max)
+	{
+		int value = min + (int)(Uniform() * ((double)max - min + 1.0));
+		return value > max ? max : value;
+	}
+
+	// Event of the branch-th ray produced by an event, a SplitMix64 finalizer over the parent event
+	static uint64_t Branch(uint64_t event, int branch)
+	{
+		uint64_t z = event + 0x9E3779B97F4A7C15ULL * (uint64_t)(branch + 1);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	// Stream the generators on this thread draw from, the Scene points it at the current ray event before each one
+	static RandomStream& Current()
+	{
+		thread_local RandomStream stream;
+		return stream;
+	}
+
+	static void Philox(const uint32_t counter[4], const uint32_t key[2], uint32_t result[4])
+	{
+		uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+		uint32_t k0 = key[0], k1 = key[1];
+
+		for (int round = 0; round < 10; round++)
+		{
+			uint64_t p0 = (uint64_t)0xD2511F53U * c0;
+			uint64_t p1 = (uint64_t)0xCD9E8D57U * c2;
+
+			uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+			uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+
+			c1 = (uint32_t)p1;
+			c3 = (uint32_t)p0;
+			c0 = n0;
+			c2 = n2;
+
+			k0 += 0x9E3779B9U;
+			k1 += 0xBB67AE85U;
+		}
+
+		result[0] = c0;
+		result[1] = c1;
+		result[2] = c2;
+		result[3] = c3;
+	}
+
+private:
+
+	uint32_t CachedBlock;
+
+	uint32_t Block[4];
+
+	// Burley, "Practical Hash-based Owen Scrambling" (2020) : every dimension of a group shares one shuffle of the ray
+	// index so the group stays jointly stratified, and each dimension gets its own nested uniform scramble
+	double SobolUniform()
+	{
+		uint32_t group = this->Draw / SOBOL_DIMENSIONS;
+		uint32_t dimension = this->Draw % SOBOL_DIMENSIONS;
+
+		this->Draw++;
+
+		uint32_t counter[4] = { group, (uint32_t)this->Event, (uint32_t)(this->Event >> 32), SOURCE_RAY };
+		uint32_t key[2] = { (uint32_t)this->Seed, (uint32_t)(this->Seed >> 32) };
+		uint32_t scramble[4];
+
+		Philox(counter, key, scramble);
+
+		uint32_t index = OwenScramble(this->RayIndex, scramble[0]);
+		uint32_t value = OwenScramble(Sobol(index, dimension), scramble[(dimension % 3) + 1] ^ (dimension * 0x9E3779B9U));
+
+		return value * (1.0 / 4294967296.0);
+	}
+
+	static uint32_t Sobol(uint32_t index, uint32_t dimension)
+	{
+		static const std::vector<std::vector<uint32_t>> directions = SobolDirections();
+
+		uint32_t result = 0;
+
+		for (int bit = 0; index != 0; bit++, index >>= 1)
+			if (index & 1)
+				result ^= directions[dimension][bit];
+
+		return result;
+	}
+
+	// Joe and Kuo direction numbers for the first SOBOL_DIMENSIONS dimensions, as (degree, coefficients, initial m)
+	static std::vector<std::vector<uint32_t>> SobolDirections()
+	{
+		const uint32_t degree[SOBOL_DIMENSIONS] = { 0, 1, 2, 3 };
+		const uint32_t coefficients[SOBOL_DIMENSIONS] = { 0, 0, 1, 1 };
+		const uint32_t initial[SOBOL_DIMENSIONS][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 3, 0 }, { 1, 3, 1 } };
+
+		std::vector<std::vector<uint32_t>> directions = std::vector<std::vector<uint32_t>>(SOBOL_DIMENSIONS, std::vector<uint32_t>(32));
+
+		for (int d = 0; d < SOBOL_DIMENSIONS; d++)
+		{
+			uint32_t s = degree[d];
+
+			for (uint32_t i = 0; i < 32; i++)
+			{
+				if (s == 0)
+					directions[d][i] = 1U << (31 - i);
+				else if (i < s)
+					directions[d][i] = initial[d][i] << (31 - i);
+				else
+				{
+					uint32_t v = directions[d][i - s] ^ (directions[d][i - s] >> s);
+
+					for (uint32_t k = 1; k < s; k++)
+						if ((coefficients[d] >> (s - 1 - k)) & 1)
+							v ^= directions[d][i - k];
+
+					directions[d][i] = v;
+				}
+			}
+		}
+
+		return directions;
+	}
+
+	static uint32_t ReverseBits(uint32_t x)
+	{
+		x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+		x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+		x = ((x >> 4) & 0x0F0F0F0FU) | ((x & 0x0F0F0F0FU) << 4);
+		x = ((x >> 8) & 0x00FF00FFU) | ((x & 0x00FF00FFU) << 8);
+		return (x >> 16) | (x << 16);
+	}
+
+	// Hash that only lets each bit depend on the bits below it, applied to the reversed value it permutes every base 2 interval
+	static uint32_t OwenScramble(uint32_t x, uint32_t seed)
+	{
+		x = ReverseBits(x);
+		x ^= x * 0x3D20ADEAU;
+		x += seed;
+		x *= (seed >> 16) | 1;
+		x ^= x * 0x05526C56U;
+		x ^= x * 0x53A22864U;
+		return ReverseBits(x);
+	}
+};
@@ -1,5 +1,8 @@
 #pragma once
 #include "Vec2.h"
+#include <cstdint>
+#include <vector>
+#include "SpectralBundle.h"
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
 class Ray
@@ -12,28 +15,45 @@ public:
 
 	int CurrentBounce;
 
-	int MaxBounce;
-
 	int Index;
 
+	// Place in the split tree, with Index it keys the random draws made at this ray's next event
+	uint64_t Event;
+
+	// Configuration of a multi-configuration bake the ray belongs to, see Scene::AddConfiguration
+	int Tag;
+
+	// Next-event estimation : the ray is still on a straight path whose capture was already scored
+	bool OnScoredPath;
+
 	double CurrentMedium;
 
 	double Power;
 
-	double OriginalPower;
-
 	double Wavelength;
 
-	Ray(double ox, double oy, double dx, double dy, double wavelength = 500, int currentBounce = 0, double power = 1.0, int maxBounce = 5000, double currentMedium=1.0) : Origin(ox, oy), Direction(dx, dy)
+	// Extra wavelengths carried along this path, an index into the bundle pool of whoever traces the ray, -1 for a
+	// monochromatic ray, see SpectralBundle
+	int Bundle;
+
+	// Leaves every field unset, for RayQueue::Get to fill in
+	Ray()
+	{
+	}
+
+	// Bounce limits are scene wide, see Scene::MaxBounce
+	Ray(double ox, double oy, double dx, double dy, double wavelength = 500, int currentBounce = 0, double power = 1.0, double currentMedium = 1.0) : Origin(ox, oy), Direction(dx, dy)
 	{
 		this->Direction.Normalize();
 		this->CurrentMedium = currentMedium;
 		this->CurrentBounce = currentBounce;
-		this->MaxBounce = maxBounce;
 		this->Power = power;
-		this->OriginalPower = power;
 		this->Wavelength = wavelength;
 		this->Index = 0;
+		this->Event = 0;
+		this->Tag = 0;
+		this->OnScoredPath = false;
+		this->Bundle = -1;
 	}
 
 	void Bounce()
@@ -41,17 +61,24 @@ public:
 		this->CurrentBounce++;
 	}
 
-	bool DestroyRay()
+	bool DestroyRay(int maxBounce)
+	{
+		return this->CurrentBounce > maxBounce || this->Power < 0.005;
+	}
+
+	// Scales the power of every wavelength the ray carries, bundles is the pool its bundle is in
+	void ScalePower(double factor, std::vector<SpectralBundle>& bundles)
 	{
-		return this->CurrentBounce > this->MaxBounce || this->Power < 0.005;
+		this->Power *= factor;
+
+		if (this->Bundle >= 0)
+			bundles[this->Bundle].Scale(factor);
 	}
 
+	// Plain copy, the direction is already normalized so it isn't rebuilt through the constructor
 	Ray Clone()
 	{
-		Ray newRay(this->Origin.X, this->Origin.Y, this->Direction.X, this->Direction.Y, this->Wavelength, this->CurrentBounce, this->Power, this->MaxBounce);
-		newRay.CurrentMedium = this->CurrentMedium;
-		newRay.Index = this->Index;
-		return newRay;
+		return *this;
 	}
 
 	Vec2 GetIntersectionPosition(double distance)
@@ -66,7 +93,6 @@ public:
 		j["Origin"] = Origin.ToJSON();
 		j["Direction"] = Direction.ToJSON();
 		j["CurrentBounce"] = CurrentBounce;
-		j["MaxBounce"] = MaxBounce;
 		j["Power"] = Power;
 		j["Wavelength"] = Wavelength;
 		j["CurrentMedium"] = CurrentMedium;
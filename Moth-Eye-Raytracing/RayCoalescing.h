@@ -0,0 +1,183 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <vector>
+#include "RayQueue.h"
+// Merges the rays of a generation that fall in the same bin of position, direction and wavelength and agree exactly on
+// everything else (medium, bounce, configuration). The merged ray follows the path of the strongest of them and carries
+// the sum of their power, so no power is gained or lost. Spectral bundles are left as they are.
+class RayCoalescing
+{
+public:
+
+	// Bin widths in scene units, radians and nm. Coalescing is off unless both position and direction tolerances are set,
+	// a wavelength tolerance of 0 only merges equal wavelengths
+	double PositionTolerance;
+
+	double DirectionTolerance;
+
+	double WavelengthTolerance;
+
+	// Keeps the descendants of each source ray apart, for tallies kept per source ray
+	bool KeepSourcesApart;
+
+	RayCoalescing(double positionTolerance = 0.0, double directionTolerance = 0.0, double wavelengthTolerance = 0.0)
+	{
+		this->PositionTolerance = positionTolerance;
+		this->DirectionTolerance = directionTolerance;
+		this->WavelengthTolerance = wavelengthTolerance;
+		this->KeepSourcesApart = false;
+	}
+
+	bool Enabled()
+	{
+		return this->PositionTolerance > 0.0 && this->DirectionTolerance > 0.0;
+	}
+
+	// Coalesces rays in place, keeping them in order of first appearance, and returns the power of the rays merged away
+	double Coalesce(RayQueue& rays, int* mergedRays)
+	{
+		int count = rays.Size();
+
+		this->Entries.clear();
+		this->Kept.resize(count);
+
+		for (int i = 0; i < count; i++)
+		{
+			this->Kept[i] = i;
+
+			if (rays.Cold[i].Bundle < 0)
+				this->Entries.push_back(BinEntry(GetKey(rays.Hot[i], rays.Cold[i]), i));
+		}
+
+		// Sorting by bin then index puts each bin together with its first ray at the front
+		std::sort(this->Entries.begin(), this->Entries.end());
+
+		double mergedPower = 0.0;
+
+		for (size_t start = 0; start < this->Entries.size();)
+		{
+			size_t end = start + 1;
+
+			while (end < this->Entries.size() && this->Entries[end].Key == this->Entries[start].Key)
+				end++;
+
+			if (end - start > 1)
+			{
+				int strongest = this->Entries[start].Index;
+				double totalPower = 0.0;
+
+				for (size_t e = start; e < end; e++)
+				{
+					int index = this->Entries[e].Index;
+
+					totalPower += rays.Hot[index].Power;
+
+					if (rays.Hot[index].Power > rays.Hot[strongest].Power)
+						strongest = index;
+
+					this->Kept[index] = -1;
+				}
+
+				mergedPower += totalPower - rays.Hot[strongest].Power;
+				*mergedRays += end - start - 1;
+
+				rays.Hot[strongest].Power = (float)totalPower;
+				this->Kept[this->Entries[start].Index] = strongest;
+			}
+
+			start = end;
+		}
+
+		this->Merged.Clear();
+		this->Merged.Reserve(count);
+
+		for (int i = 0; i < count; i++)
+			if (this->Kept[i] >= 0)
+				this->Merged.Push(rays, this->Kept[i]);
+
+		rays.Swap(this->Merged);
+
+		return mergedPower;
+	}
+
+private:
+
+	struct BinKey
+	{
+		int64_t X, Y, Angle, Wavelength;
+
+		uint64_t Medium;
+
+		int Tag, Bounce, Source;
+
+		bool OnScoredPath;
+
+		bool operator==(const BinKey& other) const
+		{
+			return std::tie(X, Y, Angle, Wavelength, Medium, Tag, Bounce, Source, OnScoredPath) ==
+				std::tie(other.X, other.Y, other.Angle, other.Wavelength, other.Medium, other.Tag, other.Bounce, other.Source, other.OnScoredPath);
+		}
+
+		bool operator<(const BinKey& other) const
+		{
+			return std::tie(X, Y, Angle, Wavelength, Medium, Tag, Bounce, Source, OnScoredPath) <
+				std::tie(other.X, other.Y, other.Angle, other.Wavelength, other.Medium, other.Tag, other.Bounce, other.Source, other.OnScoredPath);
+		}
+	};
+
+	struct BinEntry
+	{
+		BinKey Key;
+
+		int Index;
+
+		BinEntry(BinKey key, int index) : Key(key), Index(index)
+		{
+		}
+
+		bool operator<(const BinEntry& other) const
+		{
+			if (Key == other.Key)
+				return Index < other.Index;
+
+			return Key < other.Key;
+		}
+	};
+
+	// Kept between generations so their storage is reused
+	std::vector<BinEntry> Entries;
+
+	// Which ray ends up at each position, -1 once merged into another
+	std::vector<int> Kept;
+
+	RayQueue Merged;
+
+	BinKey GetKey(const PackedRay& hot, const RayPayload& cold)
+	{
+		BinKey key;
+		key.X = (int64_t)std::floor(hot.Origin.X / this->PositionTolerance);
+		key.Y = (int64_t)std::floor(hot.Origin.Y / this->PositionTolerance);
+		key.Angle = (int64_t)std::floor(std::atan2(hot.DirectionY, hot.DirectionX) / this->DirectionTolerance);
+
+		if (this->WavelengthTolerance > 0.0)
+			key.Wavelength = (int64_t)std::floor(hot.Wavelength / this->WavelengthTolerance);
+		else
+		{
+			uint32_t bits;
+			std::memcpy(&bits, &hot.Wavelength, sizeof(float));
+			key.Wavelength = bits;
+		}
+
+		std::memcpy(&key.Medium, &cold.CurrentMedium, sizeof(double));
+
+		key.Tag = cold.Tag;
+		key.Bounce = cold.CurrentBounce;
+		key.Source = this->KeepSourcesApart ? cold.Index : -1;
+		key.OnScoredPath = cold.OnScoredPath;
+		return key;
+	}
+};
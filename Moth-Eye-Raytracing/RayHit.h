@@ -1,6 +1,4 @@
 #pragma once
-class Segment;
-
 class RayHit
 {
 public:
@@ -9,11 +7,11 @@ public:
 
 	double Distance;
 
-	Segment* SegmentHit;
+	// Index into the hit Object's Segments, -1 for analytic shapes and misses
+	int SegmentHit;
 
-	RayHit(bool hit, double distance, Segment* segment) : Hit(hit), Distance(distance)
+	RayHit(bool hit, double distance, int segment) : Hit(hit), Distance(distance)
 	{
 		this->SegmentHit = segment;
 	}
 };
-
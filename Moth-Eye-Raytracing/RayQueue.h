@@ -0,0 +1,169 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Ray.h"
+// Where a queued ray is, where it goes and what it carries, 32 bytes. The origin stays in double, a float one would land
+// off the surface by more than EPSILON and hit the segment it just left again
+struct PackedRay
+{
+public:
+	Vec2 Origin;
+
+	float DirectionX;
+
+	float DirectionY;
+
+	float Power;
+
+	float Wavelength;
+};
+
+// Part only read to seed the ray's random draws and to tally it, kept in a parallel array, 32 bytes
+struct RayPayload
+{
+public:
+	uint64_t Event;
+
+	double CurrentMedium;
+
+	int32_t Index;
+
+	int32_t Tag;
+
+	// Index into RayQueue::Bundles, -1 for a monochromatic ray
+	int32_t Bundle;
+
+	// Scene::Initialize caps MaxBounce at INT16_MAX, a queued ray never has more bounces than that
+	int16_t CurrentBounce;
+
+	bool OnScoredPath;
+};
+
+// A generation of rays as parallel hot and cold arrays, with the spectral bundles stored apart for the rays that carry one,
+// so a monochromatic ray takes sizeof(PackedRay) + sizeof(RayPayload) bytes instead of a whole Ray
+class RayQueue
+{
+public:
+
+	std::vector<PackedRay> Hot;
+
+	std::vector<RayPayload> Cold;
+
+	std::vector<SpectralBundle> Bundles;
+
+	size_t Size() const
+	{
+		return this->Hot.size();
+	}
+
+	void Clear()
+	{
+		this->Hot.clear();
+		this->Cold.clear();
+		this->Bundles.clear();
+	}
+
+	void Reserve(size_t count)
+	{
+		this->Hot.reserve(count);
+		this->Cold.reserve(count);
+	}
+
+	void Swap(RayQueue& other)
+	{
+		this->Hot.swap(other.Hot);
+		this->Cold.swap(other.Cold);
+		this->Bundles.swap(other.Bundles);
+	}
+
+	// bundles is the pool the ray's spectral bundle is in, the queue keeps its own copy
+	void Push(const Ray& ray, const std::vector<SpectralBundle>& bundles)
+	{
+		PackedRay hot;
+		hot.Origin = ray.Origin;
+		hot.DirectionX = (float)ray.Direction.X;
+		hot.DirectionY = (float)ray.Direction.Y;
+		hot.Power = (float)ray.Power;
+		hot.Wavelength = (float)ray.Wavelength;
+
+		RayPayload cold;
+		cold.Event = ray.Event;
+		cold.CurrentMedium = ray.CurrentMedium;
+		cold.Index = ray.Index;
+		cold.Tag = ray.Tag;
+		cold.Bundle = -1;
+		cold.CurrentBounce = (int16_t)ray.CurrentBounce;
+		cold.OnScoredPath = ray.OnScoredPath;
+
+		if (ray.Bundle >= 0)
+		{
+			cold.Bundle = this->Bundles.size();
+			this->Bundles.push_back(bundles[ray.Bundle]);
+		}
+
+		this->Hot.push_back(hot);
+		this->Cold.push_back(cold);
+	}
+
+	// Ray i of another queue, with its bundle
+	void Push(const RayQueue& other, size_t i)
+	{
+		RayPayload cold = other.Cold[i];
+
+		if (cold.Bundle >= 0)
+		{
+			this->Bundles.push_back(other.Bundles[cold.Bundle]);
+			cold.Bundle = this->Bundles.size() - 1;
+		}
+
+		this->Hot.push_back(other.Hot[i]);
+		this->Cold.push_back(cold);
+	}
+
+	void Append(const RayQueue& other)
+	{
+		size_t first = this->Cold.size();
+		int bundleOffset = this->Bundles.size();
+
+		this->Hot.insert(this->Hot.end(), other.Hot.begin(), other.Hot.end());
+		this->Cold.insert(this->Cold.end(), other.Cold.begin(), other.Cold.end());
+		this->Bundles.insert(this->Bundles.end(), other.Bundles.begin(), other.Bundles.end());
+
+		if (bundleOffset == 0 || other.Bundles.empty())
+			return;
+
+		for (size_t i = first; i < this->Cold.size(); i++)
+			if (this->Cold[i].Bundle >= 0)
+				this->Cold[i].Bundle += bundleOffset;
+	}
+
+	// Fields are copied over as they are, the direction was normalized when the ray was queued
+	// A spectral ray's bundle is added to bundles, the pool of whoever traces it
+	Ray Get(size_t i, std::vector<SpectralBundle>& bundles) const
+	{
+		const PackedRay& hot = this->Hot[i];
+		const RayPayload& cold = this->Cold[i];
+
+		Ray ray;
+		ray.Origin = hot.Origin;
+		ray.Direction = Vec2(hot.DirectionX, hot.DirectionY);
+		ray.Power = hot.Power;
+		ray.Wavelength = hot.Wavelength;
+		ray.CurrentMedium = cold.CurrentMedium;
+		ray.Event = cold.Event;
+		ray.Index = cold.Index;
+		ray.Tag = cold.Tag;
+		ray.CurrentBounce = cold.CurrentBounce;
+		ray.OnScoredPath = cold.OnScoredPath;
+
+		ray.Bundle = -1;
+
+		if (cold.Bundle >= 0)
+		{
+			ray.Bundle = bundles.size();
+			bundles.push_back(this->Bundles[cold.Bundle]);
+		}
+
+		return ray;
+	}
+};
@@ -1,7 +1,9 @@
 #pragma once
 #include "Vec2.h"
+#include <algorithm>
 #include "Ray.h"
 #include "WavelengthGenerator.h"
+#include "RandomStream.h"
 class RaySource
 {
 public:
@@ -12,11 +14,19 @@ public:
 
 	WavelengthGenerator* WavelengthGen;
 
+	// Wavelengths carried by each ray, above 1 the rays are spectral bundles (at most SPECTRAL_SAMPLES)
+	int SpectralSamples;
+
+	// Configuration the generated rays are tagged with
+	int Tag;
+
 	RaySource(int numberOfRays, WavelengthGenerator* wavelengthGenerator, double currentMedium = 1.0)
 	{
 		this->NumberOfRays = numberOfRays;
 		this->CurrentMedium = currentMedium;
 		this->WavelengthGen = wavelengthGenerator;
+		this->SpectralSamples = 1;
+		this->Tag = 0;
 	}
 
 	~RaySource()
@@ -28,7 +38,28 @@ public:
 		}
 	}
 
-	virtual std::vector<Ray> GenerateRays()
+	// Draws the ray's wavelength, or its whole bundle which is added to bundles, once its power and medium are set
+	void AssignWavelengths(Ray& ray, std::vector<SpectralBundle>& bundles)
+	{
+		if (this->SpectralSamples <= 1)
+		{
+			ray.Wavelength = this->WavelengthGen->GenerateWavelength();
+			return;
+		}
+
+		int count = std::min(this->SpectralSamples, SPECTRAL_SAMPLES);
+		double wavelengths[SPECTRAL_SAMPLES];
+
+		this->WavelengthGen->GenerateWavelengths(wavelengths, count);
+
+		ray.Bundle = bundles.size();
+		bundles.push_back(SpectralBundle());
+		bundles.back().Set(wavelengths, count, ray.Power, ray.CurrentMedium);
+		ray.Wavelength = wavelengths[0];
+	}
+
+	// Spectral rays add their bundles to the given pool
+	virtual std::vector<Ray> GenerateRays(std::vector<SpectralBundle>&)
 	{
 		return std::vector<Ray>();
 	}
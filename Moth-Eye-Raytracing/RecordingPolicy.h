@@ -0,0 +1,29 @@
+#pragma once
+// Recording policies decide at compile time which Frames keep per-ray copies during a bake
+
+// Only the counters needed by the SceneStats are accumulated, no Frame is stored
+struct StatsOnlyRecording
+{
+	static bool Records(int)
+	{
+		return false;
+	}
+};
+
+// Only the initial Frame (the generated source rays) is stored
+struct FirstFrameRecording
+{
+	static bool Records(int frameNumber)
+	{
+		return frameNumber == 0;
+	}
+};
+
+// Every Frame is stored for the animation
+struct AnimationRecording
+{
+	static bool Records(int)
+	{
+		return true;
+	}
+};
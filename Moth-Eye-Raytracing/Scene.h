@@ -2,13 +2,54 @@
 #include <vector>
 #include "Ray.h"
 #include "Object.h"
-#include "Segment.h"
 #include <iostream>
 #include "Frame.h"
 #include <fstream>
 #include "RaySource.h"
 #include "Target.h"
+#include "ObjectInstance.h"
 #include <chrono>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <random>
+#include "ThreadPool.h"
+#include "RandomStream.h"
+#include "SceneBVH.h"
+#include "RecordingPolicy.h"
+#include "SpectralResponse.h"
+#include "Configuration.h"
+#include "RayCoalescing.h"
+#include "RayQueue.h"
+
+const int BAKE_CHUNK_SIZE = 256;
+
+const int DEPTH_FIRST_CHUNK_SIZE = 16;
+
+// Most rays one event emits : the reflected and transmitted ray, and a split bundle for every other wavelength
+const int MAX_EVENT_RAYS = SPECTRAL_SAMPLES + 1;
+
+enum class BakeOrder
+{
+	BreadthFirst,
+	DepthFirst
+};
+
+// Splitting follows both the reflected and transmitted ray at every interface
+// RussianRoulette follows one of them, chosen with probability R or T at full weight, and plays roulette with low power rays
+enum class TransportMode
+{
+	Splitting,
+	RussianRoulette
+};
+
+// Pseudorandom draws every random number independently
+// Sobol makes the same draw of every ray one coordinate of a scrambled Sobol sequence, so wavelengths and perturbances are stratified over the rays
+enum class SamplingMode
+{
+	Pseudorandom,
+	Sobol
+};
 
 class Scene
 {
@@ -25,9 +66,33 @@ public:
 		double LostPower = 0.0;
 		double DestroyedPower = 0.0;
 
+		int RouletteRays = 0;
+		std::string Transport = "Splitting";
+		std::string Sampling = "Pseudorandom";
+
+		// Rays still travelling when the bake was cut short, CapturedPower is uncertain by up to InFlightPower
+		int InFlightRays = 0;
+		double InFlightPower = 0.0;
+
+		// Rays merged into another ray of their generation and the power they carried, and the most rays in one generation
+		int CoalescedRays = 0;
+		double CoalescedPower = 0.0;
+		int PeakRays = 0;
+
+		int MaxBounce = 0;
+
+		// Standard errors over the source rays, NextEventPower is the next-event estimate of CapturedPower
+		bool NextEventEstimation = false;
+		double NextEventPower = 0.0;
+		double NextEventStandardError = 0.0;
+		double CapturedPowerStandardError = 0.0;
+
 		int CapturedRays = 0;
 		double CapturedPower = 0.0;
 
+		// Scene::Seed of the run, setting it on a new Scene replays the run exactly
+		uint64_t Seed = 0;
+
 		double InitializationTimeMS = 0.0;
 		double RenderTimeMS = 0.0;
 		double SaveTimeMS = 0.0;
@@ -47,31 +112,185 @@ public:
 			j["DestroyedRays"] = DestroyedRays;
 			j["LostPower"] = LostPower;
 			j["DestroyedPower"] = DestroyedPower;
+			j["RouletteRays"] = RouletteRays;
+			j["TransportMode"] = Transport;
+			j["SamplingMode"] = Sampling;
+			j["InFlightRays"] = InFlightRays;
+			j["InFlightPower"] = InFlightPower;
+			j["CapturedPowerUncertainty"] = InFlightPower;
+			j["CoalescedRays"] = CoalescedRays;
+			j["CoalescedPower"] = CoalescedPower;
+			j["PeakRays"] = PeakRays;
+			j["MaxBounce"] = MaxBounce;
+			j["NextEventEstimation"] = NextEventEstimation;
+			j["NextEventPower"] = NextEventPower;
+			j["NextEventStandardError"] = NextEventStandardError;
+			j["CapturedPowerStandardError"] = CapturedPowerStandardError;
 			j["CapturedRays"] = CapturedRays;
 			j["CapturedPower"] = CapturedPower;
+			j["Seed"] = Seed;
 			j["InitializationTimeMS"] = InitializationTimeMS;
 			j["RenderTimeMS"] = RenderTimeMS;
 			j["SaveTimeMS"] = SaveTimeMS;
 			j["AccumulationTimeMS"] = AccumulationTimeMS;
 			j["NumberOfFrames"] = NumberOfFrames;
 			j["NumberOfSegments"] = NumberOfSegments;
-			j["TotalNumberOfRays"] = CapturedRays + DestroyedRays + LostRays;
+			j["TotalNumberOfRays"] = CapturedRays + DestroyedRays + LostRays + RouletteRays + InFlightRays + CoalescedRays;
 			j["TotalSimTimeMS"] = InitializationTimeMS + RenderTimeMS + SaveTimeMS + AccumulationTimeMS;
 			j["Name"] = Name;
 			return j;
 		}
 	};
 
+	struct StackEntry
+	{
+	public:
+		Ray Traced;
+
+		int Depth;
+
+		StackEntry(Ray traced, int depth) : Traced(traced), Depth(depth)
+		{
+		}
+	};
+
+	struct BakeWorker
+	{
+	public:
+		Frame Counters;
+
+		std::vector<double> CapturedPower;
+
+		std::vector<double> CapturedRays;
+
+		// Indexed by ObjectInstance::InstanceIndex
+		std::vector<double> InstanceHitPower;
+
+		std::vector<double> InstanceHitRays;
+
+		// Depth-first only : counters per generation and the explicit split-tree stack
+		std::vector<Frame> DepthCounters;
+
+		std::vector<StackEntry> Stack;
+
+		// Next-event estimation only : tallies per Target, and both estimates per source ray for their variance
+		std::vector<double> NextEventPower;
+
+		std::vector<double> SourceCapturedPower;
+
+		std::vector<double> SourceNextEventPower;
+
+		// Spectral response only : captured, lost and destroyed power per wavelength bin
+		std::vector<double> SpectralCapturedPower;
+
+		std::vector<double> SpectralLostPower;
+
+		std::vector<double> SpectralDestroyedPower;
+
+		// Configurations only : tallies per tag, and captured power per Target and tag at TargetIndex * tag count + Tag
+		std::vector<ConfigurationTally> TagTallies;
+
+		std::vector<double> TagCapturedPower;
+
+		// Output of the ray being traveled (depth-first) and of the straight path probes, reused for every event
+		std::vector<Ray> Traveled;
+
+		std::vector<Ray> Probes;
+
+		std::vector<Ray> ProbeRays;
+
+		// Spectral bundles of the rays being traced, Ray::Bundle indexes it. Cleared for every ray of a breadth-first
+		// generation, and for every source ray depth-first since the whole split tree refers to it
+		std::vector<SpectralBundle> Bundles;
+
+		// Depth-first only : rays left on the stack past the generation budget
+		int InFlightRays = 0;
+
+		double InFlightPower = 0.0;
+
+		BakeWorker(int frameNumber, int targetCount, int instanceCount) : Counters(frameNumber), CapturedPower(targetCount, 0.0), CapturedRays(targetCount, 0.0), InstanceHitPower(instanceCount, 0.0), InstanceHitRays(instanceCount, 0.0)
+		{
+		}
+
+		void Reset(int frameNumber)
+		{
+			Counters = Frame(frameNumber);
+			std::fill(CapturedPower.begin(), CapturedPower.end(), 0.0);
+			std::fill(CapturedRays.begin(), CapturedRays.end(), 0.0);
+			std::fill(InstanceHitPower.begin(), InstanceHitPower.end(), 0.0);
+			std::fill(InstanceHitRays.begin(), InstanceHitRays.end(), 0.0);
+			std::fill(NextEventPower.begin(), NextEventPower.end(), 0.0);
+			std::fill(SpectralCapturedPower.begin(), SpectralCapturedPower.end(), 0.0);
+			std::fill(SpectralLostPower.begin(), SpectralLostPower.end(), 0.0);
+			std::fill(SpectralDestroyedPower.begin(), SpectralDestroyedPower.end(), 0.0);
+			std::fill(TagTallies.begin(), TagTallies.end(), ConfigurationTally());
+			std::fill(TagCapturedPower.begin(), TagCapturedPower.end(), 0.0);
+		}
+	};
+
 	std::vector<Object*> Objects;
 
+	// Shared prototypes of ObjectInstances, owned by the Scene but not traced themselves
+	std::vector<Object*> Prototypes;
+
+	std::vector<Target*> Targets;
+
+	std::vector<ObjectInstance*> Instances;
+
+	SceneBVH Accelerator;
+
 	std::vector<Ray> Rays;
 
+	// Bundles of the spectral rays in Rays
+	std::vector<SpectralBundle> Bundles;
+
+	// Breadth-first only : the generation being traced and the next one, and the output of each chunk, packed as RayQueues
+	// and kept so their storage is reused every generation
+	RayQueue Generation;
+
+	RayQueue NextGeneration;
+
+	std::vector<RayQueue> ChunkRays;
+
 	std::vector<Frame> Frames;
 
 	std::vector<RaySource*> RaySources;
 
 	std::string FileName;
 
+	BakeOrder Order;
+
+	TransportMode Transport;
+
+	SamplingMode Sampling;
+
+	// Russian roulette only : rays below this power survive with probability Power / RouletteThreshold, above the Ray::DestroyRay cutoff
+	double RouletteThreshold;
+
+	// Also scores every Target with a next-event estimate, see ScoreNextEvent
+	bool NextEventEstimation;
+
+	// Stops the bake once the power still travelling is below this fraction of the start power, 0 disables it (breadth-first only)
+	double MinInFlightFraction;
+
+	// Stops the bake after this many generations, negative for no limit
+	int MaxGenerations;
+
+	// Rays are destroyed after this many bounces without a transmission, at most INT16_MAX (see RayPayload)
+	int MaxBounce;
+
+	// Merges nearly identical rays at the end of each generation, off unless given tolerances (breadth-first only)
+	RayCoalescing Coalescing;
+
+	// Captured power per wavelength bin, disabled unless given bins
+	SpectralResponse Response;
+
+	// Source settings baked together over the same geometry, rays are tallied per configuration through their Tag
+	std::vector<Configuration> Configurations;
+
+	// Keys every random draw together with the ray index and event, random for each Scene unless set
+	uint64_t Seed;
+
 	SceneStats Stats;
 
 	// Non-copyable
@@ -84,6 +303,7 @@ public:
 
 	~Scene() {
 		for (auto* p : Objects)    delete p;
+		for (auto* p : Prototypes) delete p;
 		for (auto* p : RaySources) delete p;
 	}
 
@@ -93,6 +313,17 @@ public:
 		this->Rays = std::vector<Ray>();
 		this->Frames = std::vector<Frame>();
 		this->FileName = fileName;
+		this->Order = BakeOrder::BreadthFirst;
+		this->Transport = TransportMode::Splitting;
+		this->Sampling = SamplingMode::Pseudorandom;
+		this->RouletteThreshold = 0.05;
+		this->MinInFlightFraction = 0.0;
+		this->MaxGenerations = -1;
+		this->MaxBounce = 5000;
+		this->NextEventEstimation = false;
+
+		std::random_device device;
+		this->Seed = ((uint64_t)device() << 32) | device();
 	}
 
 	void AddObject(Object* object)
@@ -100,12 +331,20 @@ public:
 		this->Objects.push_back(object);
 	}
 
-	void AddRay(Ray ray)
+	// Hands a prototype to the Scene so it is deleted with it, ObjectInstances only reference their prototype
+	template<class ObjectType>
+	ObjectType* AddPrototype(ObjectType* prototype)
+	{
+		this->Prototypes.push_back(prototype);
+		return prototype;
+	}
+
+	void AddRay(const Ray& ray)
 	{
 		this->Rays.push_back(ray);
 	}
 
-	void AddRays(std::vector<Ray> rays)
+	void AddRays(const std::vector<Ray>& rays)
 	{
 		this->Rays.reserve(this->Rays.size() + rays.size());
 		this->Rays.insert(this->Rays.end(), rays.begin(), rays.end());
@@ -113,7 +352,7 @@ public:
 
 	void AddFrame(Frame frame)
 	{
-		this->Frames.push_back(frame);
+		this->Frames.push_back(std::move(frame));
 	}
 
 	void AddRaySource(RaySource* source)
@@ -121,15 +360,36 @@ public:
 		this->RaySources.push_back(source);
 	}
 
-	void Render(bool saveJSON = true, bool debug = true, bool saveAnimation = true, bool saveGeom = true, bool saveInitFrame = true, std::string filePath = "")
+	// The source's rays are tallied under the configuration tag, as returned by AddConfiguration
+	void AddRaySource(RaySource* source, int tag)
+	{
+		source->Tag = tag;
+		this->RaySources.push_back(source);
+	}
+
+	// Registers a configuration, e.g. a source angle, wavelength or repeat index, and returns its tag
+	int AddConfiguration(std::string name, std::map<std::string, double> parameters = std::map<std::string, double>())
 	{
-		this->Initialize(debug);
-		this->Bake(saveJSON, debug, saveAnimation);
+		this->Configurations.push_back(Configuration(name, parameters));
+		return this->Configurations.size() - 1;
+	}
+
+	void Render(bool saveJSON = true, bool debug = true, bool saveAnimation = true, bool saveGeom = true, bool saveInitFrame = true, std::string filePath = "", int threadCount = 1)
+	{
+		this->Initialize(debug, threadCount);
+
+		if (saveJSON && saveAnimation)
+			this->Bake<AnimationRecording>(debug, threadCount);
+		else if (saveJSON && saveInitFrame)
+			this->Bake<FirstFrameRecording>(debug, threadCount);
+		else
+			this->Bake<StatsOnlyRecording>(debug, threadCount);
+
 		this->AccumulateStats();
 		this->Save(saveJSON, debug, saveAnimation, saveGeom, saveInitFrame, filePath);
 	}
 
-	void Initialize(bool debug)
+	void Initialize(bool debug, int threadCount = 1)
 	{
 		auto start = std::chrono::high_resolution_clock::now();
 
@@ -142,19 +402,69 @@ public:
 		for (int i = 0; i < this->RaySources.size(); i++)
 		{
 			RaySource* source = this->RaySources[i];
-			std::vector<Ray> generatedRays = source->GenerateRays();
+
+			RandomStream::Current().Begin(this->Seed, RandomStream::SOURCE_RAY, RandomStream::Branch(RandomStream::SOURCE_EVENT, i), this->Sampling == SamplingMode::Sobol);
+			std::vector<Ray> generatedRays = source->GenerateRays(this->Bundles);
+
+			for (Ray& ray : generatedRays)
+				ray.Tag = source->Tag;
+
 			this->AddRays(generatedRays);
 
 			if (debug)
 				std::cout << "Generated " << generatedRays.size() << " Rays from Source " << i << std::endl;
 		}
 
-		for (int j = 0; j < this->Objects.size(); j++)
+		threadCount = ResolveThreadCount(threadCount);
+
+		this->Instances.clear();
+		std::vector<Object*> prototypes;
+
+		for (Object* object : this->Objects)
 		{
-			if (debug)
-				std::cout << "Building BVH for Object " << j << std::endl;
+			if (object->Type != "Instance")
+				continue;
+
+			ObjectInstance* instance = static_cast<ObjectInstance*>(object);
+			instance->InstanceIndex = this->Instances.size();
+			this->Instances.push_back(instance);
 
-			this->Objects[j]->BVH();
+			if (std::find(prototypes.begin(), prototypes.end(), instance->Prototype) == prototypes.end())
+				prototypes.push_back(instance->Prototype);
+		}
+
+		// Shared prototypes are built once, before the instances read their bounds
+		for (Object* prototype : prototypes)
+			prototype->BVH(threadCount);
+
+		if (debug)
+			std::cout << "Building BVHs for " << this->Objects.size() << " Objects (" << prototypes.size() << " Prototypes) on " << threadCount << " Thread(s)" << std::endl;
+
+		if (threadCount > 1 && this->Objects.size() >= threadCount)
+		{
+			// Enough objects to keep every thread busy, build them side by side
+			ThreadPool pool(threadCount);
+			pool.Run(this->Objects.size(), [this](int j, int /*workerIndex*/) { this->Objects[j]->BVH(); });
+		}
+		else
+		{
+			for (Object* object : this->Objects)
+				object->BVH(threadCount);
+		}
+
+		this->Accelerator.Build(this->Objects);
+
+		this->Targets.clear();
+
+		for (Object* object : this->Objects)
+		{
+			if (object->Type != "Target")
+				continue;
+
+			Target* target = static_cast<Target*>(object);
+			target->TargetIndex = this->Targets.size();
+			target->TagCapturedPower = std::vector<double>(this->Configurations.size(), 0.0);
+			this->Targets.push_back(target);
 		}
 
 		double totalPower = 0.0;
@@ -162,9 +472,26 @@ public:
 		{
 			this->Rays[i].Index = i;
 			totalPower += this->Rays[i].Power;
+
+			if (this->Response.Enabled())
+				this->Response.Add(this->Response.StartPower, &this->Rays[i], this->Bundles);
+
+			ConfigurationTally* tally = GetTagTally(this->Rays[i].Tag);
+
+			if (tally != nullptr)
+			{
+				tally->StartRays += 1;
+				tally->StartPower += this->Rays[i].Power;
+			}
 		}
 
+		Stats.Seed = this->Seed;
+		Stats.Sampling = this->Sampling == SamplingMode::Sobol ? "Sobol" : "Pseudorandom";
+		Stats.Transport = this->Transport == TransportMode::RussianRoulette ? "RussianRoulette" : "Splitting";
 		Stats.StartRays = this->Rays.size();
+		// Queued rays keep their bounce count in 16 bits
+		this->MaxBounce = std::min(this->MaxBounce, INT16_MAX);
+		Stats.MaxBounce = this->MaxBounce;
 		Stats.StartPower = totalPower;
 
 		auto end = std::chrono::high_resolution_clock::now();
@@ -174,69 +501,464 @@ public:
 			std::cout << "Finished Initializing Scene in " << Stats.InitializationTimeMS << " ms" << std::endl;
 	}
 
-	void Bake(bool saveJSON = true, bool debug = true, bool saveAnimation = true)
+	void Bake(bool saveJSON = true, bool debug = true, bool saveAnimation = true, int threadCount = 1)
+	{
+		if (saveAnimation)
+			Bake<AnimationRecording>(debug, threadCount);
+		else
+			Bake<FirstFrameRecording>(debug, threadCount);
+	}
+
+	template <class Recording>
+	void Bake(bool debug, int threadCount)
 	{
 		auto start = std::chrono::high_resolution_clock::now();
 
+		threadCount = ResolveThreadCount(threadCount);
+
 		if (debug)
-			std::cout << "Rendering Scene" << std::endl;
+			std::cout << "Rendering Scene on " << threadCount << " Thread(s)" << std::endl;
 
-		int index = 0;
+		std::unique_ptr<ThreadPool> pool;
+
+		if (threadCount > 1)
+			pool.reset(new ThreadPool(threadCount));
 
-		while (this->Rays.size() > 0)
+		std::vector<BakeWorker> workers = std::vector<BakeWorker>(threadCount, BakeWorker(0, this->Targets.size(), this->Instances.size()));
+
+		// Sized before the bake so a worker never allocates on its first event, or the allocations would depend on
+		// whether a worker got any rays to trace
+		for (BakeWorker& worker : workers)
 		{
-			Frame frame = Frame(index);
+			worker.Traveled.reserve(MAX_EVENT_RAYS);
+			worker.Bundles.reserve(MAX_EVENT_RAYS + 1);
+
+			if (this->NextEventEstimation)
+			{
+				worker.Probes.reserve(MAX_EVENT_RAYS);
+				worker.ProbeRays.reserve(MAX_EVENT_RAYS);
+			}
+		}
+
+		if (this->NextEventEstimation)
+		{
+			for (BakeWorker& worker : workers)
+			{
+				worker.NextEventPower = std::vector<double>(this->Targets.size(), 0.0);
+				worker.SourceCapturedPower = std::vector<double>(this->Rays.size(), 0.0);
+				worker.SourceNextEventPower = std::vector<double>(this->Rays.size(), 0.0);
+			}
+		}
+
+		// Per source tallies need every ray to stay with its source
+		if (this->NextEventEstimation)
+			this->Coalescing.KeepSourcesApart = true;
+
+		if (this->Response.Enabled())
+		{
+			for (BakeWorker& worker : workers)
+			{
+				worker.SpectralCapturedPower = std::vector<double>(this->Response.BinCount(), 0.0);
+				worker.SpectralLostPower = std::vector<double>(this->Response.BinCount(), 0.0);
+				worker.SpectralDestroyedPower = std::vector<double>(this->Response.BinCount(), 0.0);
+			}
+		}
+
+		if (!this->Configurations.empty())
+		{
+			for (BakeWorker& worker : workers)
+			{
+				worker.TagTallies = std::vector<ConfigurationTally>(this->Configurations.size());
+				worker.TagCapturedPower = std::vector<double>(this->Targets.size() * this->Configurations.size(), 0.0);
+			}
+		}
+
+		if (this->Order == BakeOrder::DepthFirst)
+			BakeDepthFirst<Recording>(debug, pool.get(), workers);
+		else
+			BakeBreadthFirst<Recording>(debug, pool.get(), workers);
+
+		if (this->NextEventEstimation)
+			AccumulateStandardErrors(workers);
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		Stats.RenderTimeMS = std::chrono::duration<double, std::milli>(end - start).count();
 
-			for (Ray& ray : this->Rays)
-				frame.AddRay(ray);
+		if (debug)
+			std::cout << "Rendering Complete in " << Stats.RenderTimeMS << " ms" << std::endl;
+	}
+
+	template <class Recording>
+	void BakeBreadthFirst(bool debug, ThreadPool* pool, std::vector<BakeWorker>& workers)
+	{
+		int index = 0;
 
-			std::vector<Ray> newRays = std::vector<Ray>();
+		this->Generation.Clear();
+		this->Generation.Reserve(this->Rays.size());
 
-			newRays.reserve(this->Rays.size() * 2); // Estimate
+		for (Ray& ray : this->Rays)
+			this->Generation.Push(ray, this->Bundles);
 
-			for (Ray& ray : this->Rays)
+		this->Rays.clear();
+		this->Bundles.clear();
+
+		while (this->Generation.Size() > 0)
+		{
+			if (ReachedBudget(index))
 			{
-				std::vector<Ray> traveledRays = this->Travel(&ray, &frame);
+				for (size_t i = 0; i < this->Generation.Size(); i++)
+				{
+					double power = this->Generation.Hot[i].Power;
+
+					Stats.InFlightPower += power;
+
+					ConfigurationTally* tally = GetTagTally(this->Generation.Cold[i].Tag);
+
+					if (tally != nullptr)
+					{
+						tally->InFlightRays += 1;
+						tally->InFlightPower += power;
+					}
+				}
+
+				Stats.InFlightRays += this->Generation.Size();
 
-				if (traveledRays.size() > 0)
-					newRays.insert(newRays.end(), traveledRays.begin(), traveledRays.end());
+				if (debug)
+					std::cout << "Stopped at Frame " << index << " with " << this->Generation.Size() << " Rays and " << Stats.InFlightPower << " Power in Flight" << std::endl;
+
+				this->Generation.Clear();
+				break;
 			}
 
+			Frame frame = Frame(index);
+
+			Stats.PeakRays = std::max(Stats.PeakRays, (int)this->Generation.Size());
+
+			if (Recording::Records(index))
+				frame.AddRays(this->Generation);
+
+			for (BakeWorker& worker : workers)
+				worker.Reset(index);
+
+			// Each chunk keeps its own output so the next generation has the same order as a serial bake
+			int chunkCount = (this->Generation.Size() + BAKE_CHUNK_SIZE - 1) / BAKE_CHUNK_SIZE;
+
+			if (this->ChunkRays.size() < chunkCount)
+				this->ChunkRays.resize(chunkCount);
+
+			auto travelChunk = [&](int chunk, int workerIndex)
+				{
+					BakeWorker& worker = workers[workerIndex];
+					RayQueue& traveled = this->ChunkRays[chunk];
+
+					size_t first = (size_t)chunk * BAKE_CHUNK_SIZE;
+					size_t last = std::min(first + BAKE_CHUNK_SIZE, this->Generation.Size());
+
+					traveled.Clear();
+					traveled.Reserve((last - first) * 2); // Estimate
+
+					// Rays are unpacked for their event, the full Ray and its output only ever live in this worker's cache
+					for (size_t i = first; i < last; i++)
+					{
+						worker.Bundles.clear();
+						Ray ray = this->Generation.Get(i, worker.Bundles);
+
+						worker.Traveled.clear();
+						this->Travel(&ray, &worker.Counters, &worker, worker.Traveled);
+
+						for (Ray& traveledRay : worker.Traveled)
+							traveled.Push(traveledRay, worker.Bundles);
+					}
+				};
+
+			RunChunks(pool, chunkCount, travelChunk);
+
+			for (BakeWorker& worker : workers)
+				MergeCounters(&frame, worker.Counters);
+
+			MergeTallies(workers);
+
+			size_t newRayCount = 0;
+			for (int chunk = 0; chunk < chunkCount; chunk++)
+				newRayCount += this->ChunkRays[chunk].Size();
+
+			this->NextGeneration.Clear();
+			this->NextGeneration.Reserve(newRayCount);
+
+			for (int chunk = 0; chunk < chunkCount; chunk++)
+				this->NextGeneration.Append(this->ChunkRays[chunk]);
+
+			// Done on the merged generation so the result doesn't depend on how it was chunked
+			if (this->Coalescing.Enabled())
+				Stats.CoalescedPower += this->Coalescing.Coalesce(this->NextGeneration, &Stats.CoalescedRays);
+
 			if (debug)
-				std::cout << "Rendered Frame " << index << ": " << this->Rays.size() << " Rays, " << frame.DestroyedRays << " Destroyed, " << frame.LostRays << " Lost" << std::endl;
+				std::cout << "Rendered Frame " << index << ": " << this->Generation.Size() << " Rays, " << frame.DestroyedRays << " Destroyed, " << frame.LostRays << " Lost" << std::endl;
 
-			AddFrame(frame);
-			this->Rays = newRays;
+			RecordFrame<Recording>(frame);
+			this->Generation.Swap(this->NextGeneration);
 			index++;
 		}
 
 		Frame frame = Frame(index);
 
-		AddFrame(frame);
+		RecordFrame<Recording>(frame);
+	}
 
-		auto end = std::chrono::high_resolution_clock::now();
+	// Follows each source ray's whole split tree before moving on, so memory is bounded by tree depth
+	template <class Recording>
+	void BakeDepthFirst(bool debug, ThreadPool* pool, std::vector<BakeWorker>& workers)
+	{
+		for (BakeWorker& worker : workers)
+		{
+			worker.Reset(0);
+			worker.DepthCounters.clear();
+			worker.Stack.clear();
+			worker.InFlightRays = 0;
+			worker.InFlightPower = 0.0;
+
+			// A split tree cut off at MaxGenerations never needs more, each level leaves at most its reflected ray on the stack
+			if (this->MaxGenerations >= 0)
+			{
+				worker.DepthCounters.reserve(this->MaxGenerations + 1);
+				worker.Stack.reserve(2 * (this->MaxGenerations + 1));
+			}
+		}
 
-		Stats.RenderTimeMS = std::chrono::duration<double, std::milli>(end - start).count();
+		int chunkCount = (this->Rays.size() + DEPTH_FIRST_CHUNK_SIZE - 1) / DEPTH_FIRST_CHUNK_SIZE;
 
-		if (debug)
-			std::cout << "Rendering Complete in " << Stats.RenderTimeMS << " ms" << std::endl;
+		auto traceChunk = [&](int chunk, int workerIndex)
+			{
+				BakeWorker& worker = workers[workerIndex];
+
+				size_t first = (size_t)chunk * DEPTH_FIRST_CHUNK_SIZE;
+				size_t last = std::min(first + DEPTH_FIRST_CHUNK_SIZE, this->Rays.size());
+
+				for (size_t i = first; i < last; i++)
+				{
+					Ray source = this->Rays[i];
+
+					worker.Bundles.clear();
+
+					if (source.Bundle >= 0)
+					{
+						worker.Bundles.push_back(this->Bundles[source.Bundle]);
+						source.Bundle = 0;
+					}
+
+					worker.Stack.emplace_back(source, 0);
+
+					while (!worker.Stack.empty())
+					{
+						StackEntry entry = worker.Stack.back();
+						worker.Stack.pop_back();
+
+						if (this->MaxGenerations >= 0 && entry.Depth >= this->MaxGenerations)
+						{
+							worker.InFlightRays += 1;
+							worker.InFlightPower += entry.Traced.Power;
+
+							ConfigurationTally* tally = GetTagTally(worker.TagTallies, entry.Traced.Tag);
+
+							if (tally != nullptr)
+							{
+								tally->InFlightRays += 1;
+								tally->InFlightPower += entry.Traced.Power;
+							}
+
+							continue;
+						}
+
+						while (worker.DepthCounters.size() <= entry.Depth)
+							worker.DepthCounters.push_back(Frame(worker.DepthCounters.size()));
+
+						worker.Traveled.clear();
+						this->Travel(&entry.Traced, &worker.DepthCounters[entry.Depth], &worker, worker.Traveled);
+
+						// Pushed in reverse so the first resulting ray is followed first
+						for (int r = (int)worker.Traveled.size() - 1; r >= 0; r--)
+							worker.Stack.emplace_back(worker.Traveled[r], entry.Depth + 1);
+					}
+				}
+			};
+
+		RunChunks(pool, chunkCount, traceChunk);
+
+		size_t generations = 0;
+		for (BakeWorker& worker : workers)
+			generations = std::max(generations, worker.DepthCounters.size());
+
+		for (int index = 0; index < generations; index++)
+		{
+			Frame frame = Frame(index);
+
+			if (index == 0 && Recording::Records(index))
+				for (Ray& ray : this->Rays)
+					frame.AddRay(ray, this->Bundles);
+
+			for (BakeWorker& worker : workers)
+				if (index < worker.DepthCounters.size())
+					MergeCounters(&frame, worker.DepthCounters[index]);
+
+			if (debug)
+				std::cout << "Rendered Frame " << index << ": " << frame.DestroyedRays << " Destroyed, " << frame.LostRays << " Lost" << std::endl;
+
+			RecordFrame<Recording>(frame);
+		}
+
+		MergeTallies(workers);
+
+		for (BakeWorker& worker : workers)
+		{
+			Stats.InFlightRays += worker.InFlightRays;
+			Stats.InFlightPower += worker.InFlightPower;
+		}
+
+		this->Rays.clear();
+		this->Bundles.clear();
+
+		Frame frame = Frame(generations);
+
+		RecordFrame<Recording>(frame);
 	}
 
-	void AccumulateStats()
+	// Counters always go straight into the stats, the Frame itself is only kept if the policy records it
+	template <class Recording>
+	void RecordFrame(Frame& frame)
 	{
-		auto start = std::chrono::high_resolution_clock::now();
+		Stats.NumberOfFrames += 1;
+		Stats.LostRays += frame.LostRays;
+		Stats.DestroyedRays += frame.DestroyedRays;
+		Stats.RouletteRays += frame.RouletteRays;
+		Stats.LostPower += frame.LostPower;
+		Stats.DestroyedPower += frame.DestroyedPower;
+
+		if (Recording::Records(frame.FrameNumber))
+			AddFrame(std::move(frame));
+	}
 
-		Stats.NumberOfFrames = this->Frames.size();
-		Stats.Name = FileName;
+	// Generation budget, or the power left in Rays is too small to matter
+	bool ReachedBudget(int generation)
+	{
+		if (this->MaxGenerations >= 0 && generation >= this->MaxGenerations)
+			return true;
+
+		if (this->MinInFlightFraction <= 0.0)
+			return false;
+
+		double inFlightPower = 0.0;
 
-		//Getting Stats
-		for (int i = 0; i < this->Frames.size(); i++)
+		for (PackedRay& ray : this->Generation.Hot)
+			inFlightPower += ray.Power;
+
+		return inFlightPower < this->MinInFlightFraction * Stats.StartPower;
+	}
+
+	int ResolveThreadCount(int threadCount)
+	{
+		if (threadCount <= 0)
+			return std::max(1, (int)std::thread::hardware_concurrency());
+
+		return threadCount;
+	}
+
+	template <class Job>
+	void RunChunks(ThreadPool* pool, int chunkCount, Job& job)
+	{
+		if (pool != nullptr)
+			pool->Run(chunkCount, job);
+		else
+			for (int chunk = 0; chunk < chunkCount; chunk++)
+				job(chunk, 0);
+	}
+
+	void MergeCounters(Frame* frame, Frame& counters)
+	{
+		frame->LostRays += counters.LostRays;
+		frame->DestroyedRays += counters.DestroyedRays;
+		frame->RouletteRays += counters.RouletteRays;
+		frame->LostPower += counters.LostPower;
+		frame->DestroyedPower += counters.DestroyedPower;
+	}
+
+	void MergeTallies(std::vector<BakeWorker>& workers)
+	{
+		for (BakeWorker& worker : workers)
 		{
-			Stats.LostRays += this->Frames[i].LostRays;
-			Stats.DestroyedRays += this->Frames[i].DestroyedRays;
-			Stats.LostPower += this->Frames[i].LostPower;
-			Stats.DestroyedPower += this->Frames[i].DestroyedPower;
+			for (int t = 0; t < this->Targets.size(); t++)
+			{
+				this->Targets[t]->CapturedPower += worker.CapturedPower[t];
+				this->Targets[t]->CapturedRays += worker.CapturedRays[t];
+
+				worker.CapturedPower[t] = 0.0;
+				worker.CapturedRays[t] = 0.0;
+			}
+
+			for (int i = 0; i < this->Instances.size(); i++)
+			{
+				this->Instances[i]->HitPower += worker.InstanceHitPower[i];
+				this->Instances[i]->HitRays += worker.InstanceHitRays[i];
+
+				worker.InstanceHitPower[i] = 0.0;
+				worker.InstanceHitRays[i] = 0.0;
+			}
+
+			for (int t = 0; t < worker.NextEventPower.size(); t++)
+			{
+				this->Targets[t]->NextEventPower += worker.NextEventPower[t];
+				worker.NextEventPower[t] = 0.0;
+			}
+
+			for (int bin = 0; bin < worker.SpectralCapturedPower.size(); bin++)
+			{
+				this->Response.CapturedPower[bin] += worker.SpectralCapturedPower[bin];
+				this->Response.LostPower[bin] += worker.SpectralLostPower[bin];
+				this->Response.DestroyedPower[bin] += worker.SpectralDestroyedPower[bin];
+				worker.SpectralCapturedPower[bin] = 0.0;
+				worker.SpectralLostPower[bin] = 0.0;
+				worker.SpectralDestroyedPower[bin] = 0.0;
+			}
+
+			for (int tag = 0; tag < worker.TagTallies.size(); tag++)
+			{
+				this->Configurations[tag].Tally.Merge(worker.TagTallies[tag]);
+				worker.TagTallies[tag] = ConfigurationTally();
+			}
+
+			int tagCount = this->Configurations.size();
+
+			for (int i = 0; i < worker.TagCapturedPower.size(); i++)
+			{
+				this->Targets[i / tagCount]->TagCapturedPower[i % tagCount] += worker.TagCapturedPower[i];
+				worker.TagCapturedPower[i] = 0.0;
+			}
 		}
+	}
+
+	// Tally of a ray's configuration, nullptr if the Scene has no configurations or the tag isn't one of them
+	ConfigurationTally* GetTagTally(std::vector<ConfigurationTally>& tallies, int tag)
+	{
+		if (tag < 0 || tag >= tallies.size())
+			return nullptr;
+
+		return &tallies[tag];
+	}
+
+	// Scene level tally, only used outside the bake
+	ConfigurationTally* GetTagTally(int tag)
+	{
+		if (tag < 0 || tag >= this->Configurations.size())
+			return nullptr;
+
+		return &this->Configurations[tag].Tally;
+	}
+
+	void AccumulateStats()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		Stats.Name = FileName;
 
 		for (int j = 0; j < this->Objects.size(); j++)
 		{
@@ -246,9 +968,10 @@ public:
 
 				Stats.CapturedPower += target->CapturedPower;
 				Stats.CapturedRays += target->CapturedRays;
+				Stats.NextEventPower += target->NextEventPower;
 			}
 
-			Stats.NumberOfSegments += this->Objects[j]->Segments.size();
+			Stats.NumberOfSegments += this->Objects[j]->Segments.Size();
 		}
 
 		for (int i = 0; i < this->RaySources.size(); i++)
@@ -257,7 +980,7 @@ public:
 
 			Object* obj = source->GetObject();
 
-			if (obj->Segments.empty())
+			if (obj->Segments.Empty())
 			{
 				delete obj;
 				continue;
@@ -300,7 +1023,7 @@ public:
 				j["Frames"].push_back(frame.ToJSON());
 		}
 		else
-			if (saveInitFrame)
+			if (saveInitFrame && !this->Frames.empty())
 				j["Frames"].push_back(this->Frames[0].ToJSON());
 
 		if (debug)
@@ -312,6 +1035,18 @@ public:
 
 		j["Stats"] = Stats.ToJSON();
 
+		if (this->Response.Enabled())
+			j["SpectralResponse"] = this->Response.ToJSON();
+
+		// One row per configuration
+		if (!this->Configurations.empty())
+		{
+			j["Configurations"] = json::array();
+
+			for (int tag = 0; tag < this->Configurations.size(); tag++)
+				j["Configurations"].push_back(this->Configurations[tag].ToJSON(tag));
+		}
+
 		//Save the File 
 		std::string fullFilePath = "";
 
@@ -328,45 +1063,287 @@ public:
 			std::cout << "Render Saved" << std::endl;
 	}
 
-	std::vector<Ray> Travel(Ray* ray, Frame* frame)
+	// Appends the rays the event produces to output, ray must not live in output
+	void Travel(Ray* ray, Frame* frame, BakeWorker* worker, std::vector<Ray>& output)
 	{
+		// Draws made during this event only depend on the ray, not on the thread or the order it is traced in
+		uint64_t event = ray->Event;
+		RandomStream::Current().Begin(this->Seed, ray->Index, event, this->Sampling == SamplingMode::Sobol);
+
+		ConfigurationTally* tally = GetTagTally(worker->TagTallies, ray->Tag);
+
 		ray->Bounce();
 
-		if (ray->DestroyRay())
+		if (this->Transport == TransportMode::RussianRoulette && ray->Power < this->RouletteThreshold)
+		{
+			// Survivors carry the threshold power so the expected power is unchanged
+			if (RandomUnit() * this->RouletteThreshold >= ray->Power)
+			{
+				frame->RouletteRays += 1;
+
+				if (tally != nullptr)
+					tally->RouletteRays += 1;
+
+				return;
+			}
+
+			ray->ScalePower(this->RouletteThreshold / ray->Power, worker->Bundles);
+		}
+
+		if (ray->DestroyRay(this->MaxBounce))
 		{
 			frame->DestroyedRays += 1;
 			frame->DestroyedPower += ray->Power;
-			return std::vector<Ray>();
+
+			if (this->Response.Enabled())
+				this->Response.Add(worker->SpectralDestroyedPower, ray, worker->Bundles);
+
+			if (tally != nullptr)
+			{
+				tally->DestroyedRays += 1;
+				tally->DestroyedPower += ray->Power;
+			}
+
+			return;
 		}
 
-		double minT = INFINITY;
-		double minTSqr = INFINITY;
-		Segment* closestSegment = nullptr;
 		Object* closestObject = nullptr;
+		RayHit hit = this->Accelerator.Intersect(ray, &closestObject);
 
-		for (Object* object : this->Objects)
+		if (!hit.Hit || closestObject == nullptr)
+		{
+			frame->LostRays += 1;
+			frame->LostPower += ray->Power;
+
+			if (this->Response.Enabled())
+				this->Response.Add(worker->SpectralLostPower, ray, worker->Bundles);
+
+			if (tally != nullptr)
+			{
+				tally->LostRays += 1;
+				tally->LostPower += ray->Power;
+			}
+
+			return;
+		}
+
+		// Targets are tallied per worker and merged at the end of the generation
+		if (closestObject->Type == "Target")
+		{
+			Target* target = static_cast<Target*>(closestObject);
+
+			worker->CapturedPower[target->TargetIndex] += ray->Power;
+			worker->CapturedRays[target->TargetIndex] += 1.0;
+
+			if (this->Response.Enabled())
+				this->Response.Add(worker->SpectralCapturedPower, ray, worker->Bundles);
+
+			if (tally != nullptr)
+			{
+				tally->CapturedRays += 1;
+				tally->CapturedPower += ray->Power;
+				worker->TagCapturedPower[target->TargetIndex * this->Configurations.size() + ray->Tag] += ray->Power;
+			}
+
+			if (this->NextEventEstimation)
+			{
+				worker->SourceCapturedPower[ray->Index] += ray->Power;
+
+				// Captures along an already scored path are in the next-event tally through their estimate instead
+				if (!ray->OnScoredPath)
+				{
+					worker->NextEventPower[target->TargetIndex] += ray->Power;
+					worker->SourceNextEventPower[ray->Index] += ray->Power;
+				}
+			}
+
+			return;
+		}
+
+		if (closestObject->Type == "Instance")
 		{
-			if (minTSqr < object->ShortestDistanceSqr(ray))
+			ObjectInstance* instance = static_cast<ObjectInstance*>(closestObject);
+
+			worker->InstanceHitPower[instance->InstanceIndex] += ray->Power;
+			worker->InstanceHitRays[instance->InstanceIndex] += 1.0;
+		}
+
+		HitContext context = closestObject->GetHitContext(hit, ray);
+
+		size_t first = output.size();
+		closestObject->InteractWithRay(context, ray, output, worker->Bundles);
+
+		for (size_t r = first; r < output.size(); r++)
+			output[r].Event = RandomStream::Branch(event, r - first);
+
+		if (this->NextEventEstimation)
+			ScoreNextEvent(closestObject, output, first, worker);
+
+		if (this->Transport == TransportMode::RussianRoulette && output.size() - first > 1)
+			SelectBranch(output, first, worker->Bundles);
+	}
+
+	// Objects using the Fresnel Object::InteractWithRay, which returns the reflected ray then the transmitted ray
+	bool IsInterface(Object* object)
+	{
+		return object->Type == "Object" || object->Type == "LayerStack" || object->Type == "HeightField" || object->Type == "Wave";
+	}
+
+	// Next-event estimation : when a transmitted ray starts a new straight path, the power that path delivers to a Target
+	// by transmitting through every interface it meets is scored right away. Captures of rays still on that path are then
+	// left out of the next-event tally, so it stays unbiased while skipping the noise of following the path.
+	// Any reflection or non-interface object ends the straight path.
+	// The event's rays are rays[first] onwards
+	void ScoreNextEvent(Object* object, std::vector<Ray>& rays, size_t first, BakeWorker* worker)
+	{
+		if (!IsInterface(object) || rays.size() - first < 2)
+		{
+			for (size_t r = first; r < rays.size(); r++)
+				rays[r].OnScoredPath = false;
+
+			return;
+		}
+
+		rays[first].OnScoredPath = false;
+
+		// Every ray after the reflected one is transmitted, a spectral bundle can split off wavelengths that disperse away from it
+		for (size_t r = first + 1; r < rays.size(); r++)
+		{
+			Ray& transmitted = rays[r];
+
+			if (transmitted.OnScoredPath || transmitted.Power <= 0.0)
 				continue;
 
-			RayHit hit = object->Intersect(ray);
+			ProbeStraightPath(transmitted, worker);
+
+			transmitted.OnScoredPath = true;
+		}
+	}
+
+	// Follows only the transmitted rays through interfaces, no power cutoff so the estimate includes what analog rays lose to it
+	// The bundles the probes add to the worker's pool are dropped again once they are done
+	void ProbeStraightPath(Ray probe, BakeWorker* worker)
+	{
+		std::vector<Ray>& probes = worker->Probes;
+		std::vector<Ray>& rays = worker->ProbeRays;
 
-			if (hit.Hit && hit.Distance < minT)
+		size_t bundleCount = worker->Bundles.size();
+
+		probes.clear();
+		probes.push_back(probe);
+
+		while (!probes.empty())
+		{
+			Ray current = probes.back();
+			probes.pop_back();
+
+			for (int step = 0; step <= this->MaxBounce && current.Power > 0.0; step++)
 			{
-				minT = hit.Distance;
-				minTSqr = minT * minT;
-				closestSegment = hit.SegmentHit;
-				closestObject = object;
+				Object* hitObject = nullptr;
+				RayHit hit = this->Accelerator.Intersect(&current, &hitObject);
+
+				if (!hit.Hit || hitObject == nullptr || !(hitObject->Type == "Target" || IsInterface(hitObject)))
+					break;
+
+				if (hitObject->Type == "Target")
+				{
+					worker->NextEventPower[static_cast<Target*>(hitObject)->TargetIndex] += current.Power;
+					worker->SourceNextEventPower[current.Index] += current.Power;
+					break;
+				}
+
+				HitContext context = hitObject->GetHitContext(hit, &current);
+
+				rays.clear();
+				hitObject->InteractWithRay(context, &current, rays, worker->Bundles);
+
+				if (rays.size() < 2)
+					break;
+
+				for (int r = 2; r < rays.size(); r++)
+					probes.push_back(rays[r]);
+
+				current = rays[1];
 			}
 		}
 
-		if (closestSegment == nullptr || closestObject == nullptr)
+		worker->Bundles.resize(bundleCount);
+	}
+
+	// Both estimates are sums over independent source rays, so their variance is StartRays times the per-source variance
+	void AccumulateStandardErrors(std::vector<BakeWorker>& workers)
+	{
+		int sourceCount = workers[0].SourceCapturedPower.size();
+
+		Stats.NextEventEstimation = true;
+
+		if (sourceCount < 2)
+			return;
+
+		double capturedSum = 0.0, capturedSquares = 0.0;
+		double nextEventSum = 0.0, nextEventSquares = 0.0;
+
+		for (int i = 0; i < sourceCount; i++)
 		{
-			frame->LostRays += 1;
-			frame->LostPower += ray->Power;
-			return std::vector<Ray>();
+			double captured = 0.0;
+			double nextEvent = 0.0;
+
+			for (BakeWorker& worker : workers)
+			{
+				captured += worker.SourceCapturedPower[i];
+				nextEvent += worker.SourceNextEventPower[i];
+			}
+
+			capturedSum += captured;
+			capturedSquares += captured * captured;
+			nextEventSum += nextEvent;
+			nextEventSquares += nextEvent * nextEvent;
 		}
 
-		return closestObject->InteractWithRay(closestSegment, ray);
+		double capturedVariance = (capturedSquares - capturedSum * capturedSum / sourceCount) / (sourceCount - 1);
+		double nextEventVariance = (nextEventSquares - nextEventSum * nextEventSum / sourceCount) / (sourceCount - 1);
+
+		Stats.CapturedPowerStandardError = std::sqrt(std::max(0.0, capturedVariance) * sourceCount);
+		Stats.NextEventStandardError = std::sqrt(std::max(0.0, nextEventVariance) * sourceCount);
+	}
+
+	// Keeps one of rays[first] onwards with probability proportional to its power and gives it the power of all of them
+	void SelectBranch(std::vector<Ray>& rays, size_t first, std::vector<SpectralBundle>& bundles)
+	{
+		double totalPower = 0.0;
+
+		for (size_t i = first; i < rays.size(); i++)
+			totalPower += rays[i].Power;
+
+		if (totalPower <= 0.0)
+			return;
+
+		double pick = RandomUnit() * totalPower;
+		size_t chosen = rays.size() - 1;
+
+		for (size_t i = first; i < rays.size(); i++)
+		{
+			pick -= rays[i].Power;
+
+			if (pick < 0.0)
+			{
+				chosen = i;
+				break;
+			}
+		}
+
+		// The last ray is only a fallback for rounding, it must still be able to carry power
+		while (chosen > first && rays[chosen].Power <= 0.0)
+			chosen--;
+
+		rays[first] = rays[chosen];
+		rays[first].ScalePower(totalPower / rays[first].Power, bundles);
+
+		rays.erase(rays.begin() + first + 1, rays.end());
+	}
+
+	double RandomUnit()
+	{
+		return RandomStream::Current().Uniform();
 	}
 };
\ No newline at end of file
@@ -0,0 +1,166 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "Object.h"
+#include "ObjectNode.h"
+#include "RayHit.h"
+// Top level BVH over the bounds of every Object in a Scene, leaves reference ranges of Objects
+class SceneBVH
+{
+public:
+
+	static const int STACK_SIZE = 64;
+
+	std::vector<ObjectNode> Nodes;
+
+	std::vector<Object*> Objects;
+
+	int LeafSize;
+
+	SceneBVH()
+	{
+		Nodes = std::vector<ObjectNode>();
+		Objects = std::vector<Object*>();
+		LeafSize = 2;
+	}
+
+	// Objects must already have their own BVH built
+	void Build(std::vector<Object*>& objects)
+	{
+		Nodes.clear();
+		Objects.clear();
+
+		for (Object* object : objects)
+			if (!object->Nodes.empty())
+				Objects.push_back(object);
+
+		if (Objects.empty())
+			return;
+
+		Nodes.reserve(2 * Objects.size());
+
+		Split(0, Objects.size());
+	}
+
+	// Closest hit over all objects, visiting nodes front to back and skipping anything past the best hit
+	RayHit Intersect(Ray* ray, Object** hitObject)
+	{
+		*hitObject = nullptr;
+
+		if (Nodes.empty())
+			return RayHit(false, 0.0, -1);
+
+		double minT = INFINITY;
+		int closestSegment = -1;
+
+		int stack[STACK_SIZE];
+		int stackSize = 0;
+
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			int nodeIndex = stack[--stackSize];
+			ObjectNode& node = Nodes[nodeIndex];
+
+			double tEnter, tExit;
+
+			if (!node.Bounds.Intersects(ray, tEnter, tExit) || tEnter > minT)
+				continue;
+
+			if (node.IsLeaf())
+			{
+				for (int i = node.Start; i < node.Start + node.Count; i++)
+				{
+					RayHit hit = Objects[i]->Intersect(ray);
+
+					if (hit.Hit && hit.Distance < minT)
+					{
+						minT = hit.Distance;
+						closestSegment = hit.SegmentHit;
+						*hitObject = Objects[i];
+					}
+				}
+
+				continue;
+			}
+
+			int left = nodeIndex + 1;
+			int right = node.Start;
+
+			double leftEnter, leftExit, rightEnter, rightExit;
+			bool hitLeft = Nodes[left].Bounds.Intersects(ray, leftEnter, leftExit);
+			bool hitRight = Nodes[right].Bounds.Intersects(ray, rightEnter, rightExit);
+
+			// Farther child goes on the stack first so the nearer one is visited next
+			if (hitLeft && hitRight)
+			{
+				if (leftEnter <= rightEnter)
+				{
+					stack[stackSize++] = right;
+					stack[stackSize++] = left;
+				}
+				else
+				{
+					stack[stackSize++] = left;
+					stack[stackSize++] = right;
+				}
+			}
+			else if (hitLeft)
+				stack[stackSize++] = left;
+			else if (hitRight)
+				stack[stackSize++] = right;
+		}
+
+		if (*hitObject == nullptr)
+			return RayHit(false, 0.0, -1);
+
+		// Analytic shapes such as QuantumDot hit without a segment
+		return RayHit(true, minT, closestSegment);
+	}
+
+private:
+
+	void Split(int start, int end)
+	{
+		int nodeIndex = Nodes.size();
+		Nodes.push_back(ObjectNode());
+
+		ObjectBounds bounds = ObjectBounds();
+		ObjectBounds centerBounds = ObjectBounds();
+
+		for (int i = start; i < end; i++)
+		{
+			bounds.GrowToInclude(Objects[i]->Bounds);
+			centerBounds.GrowToInclude(Vec2(Objects[i]->Bounds.GetCenterX(), Objects[i]->Bounds.GetCenterY()));
+		}
+
+		int count = end - start;
+
+		Nodes[nodeIndex].Bounds = bounds;
+		Nodes[nodeIndex].Start = start;
+		Nodes[nodeIndex].Count = count;
+
+		//Base Case
+		if (count <= LeafSize)
+			return;
+
+		// Object median along the largest extent of the centers keeps the tree balanced
+		bool isSplitX = centerBounds.LargestDimensionIsX();
+		int mid = start + count / 2;
+
+		std::nth_element(Objects.begin() + start, Objects.begin() + mid, Objects.begin() + end, [isSplitX](Object* a, Object* b)
+			{
+				if (isSplitX)
+					return a->Bounds.GetCenterX() < b->Bounds.GetCenterX();
+				else
+					return a->Bounds.GetCenterY() < b->Bounds.GetCenterY();
+			});
+
+		Nodes[nodeIndex].Count = 0;
+
+		Split(start, mid);
+		Nodes[nodeIndex].Start = Nodes.size();
+		Split(mid, end);
+	}
+};
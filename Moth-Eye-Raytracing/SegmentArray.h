@@ -0,0 +1,156 @@
+#pragma once
+#include <vector>
+#include "Vec2.h"
+#include "RayHit.h"
+#include "Ray.h"
+#include "cmath"
+#include <nlohmann/json.hpp>
+#include <iostream>
+using json = nlohmann::json;
+// Segments of an Object as parallel arrays, edge vectors and normals are worked out once when a segment is added
+// Intersection only reads the A and edge arrays, what the surface is made of is looked up through Material
+class SegmentArray
+{
+public:
+
+	std::vector<double> AX;
+
+	std::vector<double> AY;
+
+	std::vector<double> BX;
+
+	std::vector<double> BY;
+
+	// B - A
+	std::vector<double> EdgeX;
+
+	std::vector<double> EdgeY;
+
+	// Unperturbed unit normal on the left of the edge
+	std::vector<double> NormalX;
+
+	std::vector<double> NormalY;
+
+	// Index into the owning Object's Materials
+	std::vector<int> Material;
+
+	int Size() const
+	{
+		return this->AX.size();
+	}
+
+	bool Empty() const
+	{
+		return this->AX.empty();
+	}
+
+	void Clear()
+	{
+		Reorder(std::vector<int>());
+	}
+
+	void Add(double x1, double y1, double x2, double y2, int material)
+	{
+		Vec2 edge = Vec2(x2, y2) - Vec2(x1, y1);
+		Vec2 normal = edge.GetNormal(true);
+
+		this->AX.push_back(x1);
+		this->AY.push_back(y1);
+		this->BX.push_back(x2);
+		this->BY.push_back(y2);
+		this->EdgeX.push_back(edge.X);
+		this->EdgeY.push_back(edge.Y);
+		this->NormalX.push_back(normal.X);
+		this->NormalY.push_back(normal.Y);
+		this->Material.push_back(material);
+	}
+
+	// Segment order[i] moves to position i, segments left out of order are dropped
+	void Reorder(const std::vector<int>& order)
+	{
+		ReorderArray(this->AX, order);
+		ReorderArray(this->AY, order);
+		ReorderArray(this->BX, order);
+		ReorderArray(this->BY, order);
+		ReorderArray(this->EdgeX, order);
+		ReorderArray(this->EdgeY, order);
+		ReorderArray(this->NormalX, order);
+		ReorderArray(this->NormalY, order);
+		ReorderArray(this->Material, order);
+	}
+
+	Vec2 GetA(int index) const
+	{
+		return Vec2(this->AX[index], this->AY[index]);
+	}
+
+	Vec2 GetB(int index) const
+	{
+		return Vec2(this->BX[index], this->BY[index]);
+	}
+
+	Vec2 GetEdge(int index) const
+	{
+		return Vec2(this->EdgeX[index], this->EdgeY[index]);
+	}
+
+	Vec2 GetNormal(int index) const
+	{
+		return Vec2(this->NormalX[index], this->NormalY[index]);
+	}
+
+	double GetCenterX(int index) const
+	{
+		return 0.5 * (this->AX[index] + this->BX[index]);
+	}
+
+	double GetCenterY(int index) const
+	{
+		return 0.5 * (this->AY[index] + this->BY[index]);
+	}
+
+	RayHit Intersect(int index, Ray* ray) const
+	{
+		Vec2 segment = GetEdge(index);
+
+		double denom = ray->Direction.Cross(segment);
+
+		if (std::abs(denom) <= EPSILON)
+			// Parallel lines
+			return RayHit(false, 0.0, -1);
+
+		double invDenom = 1.0 / denom;
+		Vec2 aToOrigin = GetA(index) - ray->Origin;
+
+		double t = aToOrigin.Cross(segment) * invDenom;
+		double s = aToOrigin.Cross(ray->Direction) * invDenom;
+
+		if (t < EPSILON || (s < 0.0 || s > 1.0))
+			// No intersection
+			return RayHit(false, 0.0, -1);
+
+		return RayHit(true, t, index);
+	}
+
+	json ToJSON(int index) const
+	{
+		json j;
+		j["A"] = GetA(index).ToJSON();
+		j["B"] = GetB(index).ToJSON();
+		return j;
+	}
+
+private:
+
+	template<class T>
+	static void ReorderArray(std::vector<T>& values, const std::vector<int>& order)
+	{
+		std::vector<T> ordered;
+		ordered.reserve(order.size());
+
+		for (int index : order)
+			ordered.push_back(values[index]);
+
+		values.swap(ordered);
+	}
+};
@@ -0,0 +1,78 @@
+#pragma once
+// Most wavelengths one ray can carry
+const int SPECTRAL_SAMPLES = 8;
+
+// A wavelength leaves its bundle once its refracted direction is this far (radians) from the hero's
+const double DISPERSION_SPLIT_ANGLE = 1e-3;
+
+// Wavelengths travelling together along one ray path, sample 0 is the hero that the ray's Wavelength and CurrentMedium follow
+// Bundles are pooled outside the Ray, which refers to its own by Ray::Bundle. A ray left with one wavelength drops its
+// bundle and is monochromatic again, it only uses Ray::Wavelength, Power and CurrentMedium
+struct SpectralBundle
+{
+public:
+
+	int Count;
+
+	double Wavelengths[SPECTRAL_SAMPLES];
+
+	double Powers[SPECTRAL_SAMPLES];
+
+	// Refractive index each wavelength is currently travelling in
+	double Media[SPECTRAL_SAMPLES];
+
+	SpectralBundle()
+	{
+		this->Count = 0;
+	}
+
+	// Splits power evenly over the wavelengths
+	void Set(const double* wavelengths, int count, double power, double medium)
+	{
+		this->Count = count;
+
+		for (int k = 0; k < count; k++)
+		{
+			this->Wavelengths[k] = wavelengths[k];
+			this->Powers[k] = power / count;
+			this->Media[k] = medium;
+		}
+	}
+
+	void Add(double wavelength, double power, double medium)
+	{
+		this->Wavelengths[this->Count] = wavelength;
+		this->Powers[this->Count] = power;
+		this->Media[this->Count] = medium;
+		this->Count++;
+	}
+
+	double TotalPower()
+	{
+		double total = 0.0;
+
+		for (int k = 0; k < this->Count; k++)
+			total += this->Powers[k];
+
+		return total;
+	}
+
+	void Scale(double factor)
+	{
+		for (int k = 0; k < this->Count; k++)
+			this->Powers[k] *= factor;
+	}
+
+	// Keeps the order so the hero stays first
+	void Remove(int sample)
+	{
+		for (int k = sample; k + 1 < this->Count; k++)
+		{
+			this->Wavelengths[k] = this->Wavelengths[k + 1];
+			this->Powers[k] = this->Powers[k + 1];
+			this->Media[k] = this->Media[k + 1];
+		}
+
+		this->Count--;
+	}
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+#include "Ray.h"
+using json = nlohmann::json;
+// Start, captured, lost and destroyed power in uniform wavelength bins, so one scene gives the whole spectral response curve
+class SpectralResponse
+{
+public:
+
+	double MinWavelength;
+
+	double MaxWavelength;
+
+	std::vector<double> StartPower;
+
+	std::vector<double> CapturedPower;
+
+	std::vector<double> LostPower;
+
+	std::vector<double> DestroyedPower;
+
+	// No bins disables the tally
+	SpectralResponse(double minWavelength = 0.0, double maxWavelength = 0.0, int binCount = 0) : StartPower(binCount, 0.0), CapturedPower(binCount, 0.0), LostPower(binCount, 0.0), DestroyedPower(binCount, 0.0)
+	{
+		this->MinWavelength = minWavelength;
+		this->MaxWavelength = maxWavelength;
+	}
+
+	bool Enabled()
+	{
+		return !StartPower.empty();
+	}
+
+	int BinCount()
+	{
+		return StartPower.size();
+	}
+
+	int GetBin(double wavelength)
+	{
+		int bin = (int)((wavelength - MinWavelength) / (MaxWavelength - MinWavelength) * BinCount());
+		return std::min(std::max(bin, 0), BinCount() - 1);
+	}
+
+	double GetBinWavelength(int bin)
+	{
+		return MinWavelength + (MaxWavelength - MinWavelength) * (bin + 0.5) / BinCount();
+	}
+
+	// Adds the ray's power per wavelength to bins, which has BinCount entries, bundles is the pool its bundle is in
+	void Add(std::vector<double>& bins, Ray* ray, const std::vector<SpectralBundle>& bundles)
+	{
+		if (ray->Bundle < 0)
+		{
+			bins[GetBin(ray->Wavelength)] += ray->Power;
+			return;
+		}
+
+		const SpectralBundle& spectrum = bundles[ray->Bundle];
+
+		for (int k = 0; k < spectrum.Count; k++)
+			bins[GetBin(spectrum.Wavelengths[k])] += spectrum.Powers[k];
+	}
+
+	json ToJSON()
+	{
+		json j;
+		std::vector<double> wavelengths;
+		std::vector<double> response;
+		std::vector<double> reflectance;
+		std::vector<double> absorbance;
+
+		// Fractions of the start power, Response is the captured one
+		for (int bin = 0; bin < BinCount(); bin++)
+		{
+			wavelengths.push_back(GetBinWavelength(bin));
+			response.push_back(StartPower[bin] > 0.0 ? CapturedPower[bin] / StartPower[bin] : 0.0);
+			reflectance.push_back(StartPower[bin] > 0.0 ? LostPower[bin] / StartPower[bin] : 0.0);
+			absorbance.push_back(StartPower[bin] > 0.0 ? DestroyedPower[bin] / StartPower[bin] : 0.0);
+		}
+
+		j["Wavelength"] = wavelengths;
+		j["StartPower"] = StartPower;
+		j["CapturedPower"] = CapturedPower;
+		j["LostPower"] = LostPower;
+		j["DestroyedPower"] = DestroyedPower;
+		j["Response"] = response;
+		j["Reflectance"] = reflectance;
+		j["Absorbance"] = absorbance;
+		return j;
+	}
+};
@@ -11,21 +11,29 @@ public:
 
 	double CapturedRays;
 
+	// Next-event estimate of CapturedPower, only filled when the Scene enables it
+	double NextEventPower;
+
+	// Captured power per configuration, only filled when the Scene has configurations
+	std::vector<double> TagCapturedPower;
+
+	int TargetIndex;
+
 	Target(double x1, double y1, double x2, double y2) : Object(), PerturbanceGen(0)
 	{
 		this->Type = "Target";
-		this->AddSegment(x1, y1, x2, y2, [](double) {return 1.0;}, &PerturbanceGen);
+		this->AddSegment(x1, y1, x2, y2, this->AddMaterial([](double) {return 1.0;}, &PerturbanceGen));
 
 		this->CapturedPower = 0.0;
 		this->CapturedRays = 0.0;
+		this->NextEventPower = 0.0;
+		this->TargetIndex = -1;
 	}
 
-	std::vector<Ray> InteractWithRay(Segment* segment, Ray* ray) override
+	void InteractWithRay(HitContext&, Ray* ray, std::vector<Ray>&, std::vector<SpectralBundle>&) override
 	{
 		this->CapturedPower += ray->Power;
 		this->CapturedRays += 1.0;
-
-		return std::vector<Ray>();
 	}
 
 	json ToJSON() override
@@ -33,6 +41,11 @@ public:
 		json j = Object::ToJSON();
 		j["CapturedPower"] = this->CapturedPower;
 		j["CapturedRays"] = this->CapturedRays;
+		j["NextEventPower"] = this->NextEventPower;
+
+		if (!this->TagCapturedPower.empty())
+			j["TagCapturedPower"] = this->TagCapturedPower;
+
 		return j;
 	}
 };
\ No newline at end of file
@@ -0,0 +1,205 @@
+#pragma once
+#include <vector>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+class ThreadPool
+{
+public:
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	ThreadPool(int threadCount)
+	{
+		if (threadCount < 1)
+			threadCount = 1;
+
+		this->Stopping = false;
+		this->Generation = 0;
+		this->Remaining = 0;
+
+		for (int i = 0; i < threadCount; i++)
+			this->Queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+
+		// The calling thread acts as worker 0, so only spawn the rest
+		for (int i = 1; i < threadCount; i++)
+			this->Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->Lock);
+			this->Stopping = true;
+		}
+
+		this->WorkReady.notify_all();
+
+		for (std::thread& worker : this->Workers)
+			worker.join();
+	}
+
+	int GetThreadCount()
+	{
+		return (int)this->Queues.size();
+	}
+
+	// Runs job(taskIndex, workerIndex) for every task and blocks until all are complete
+	// The job is called through a pointer rather than copied into a std::function, so a run doesn't allocate
+	template <class JobType>
+	void Run(int taskCount, JobType&& job)
+	{
+		if (taskCount <= 0)
+			return;
+
+		int threadCount = GetThreadCount();
+
+		typedef typename std::remove_reference<JobType>::type Callable;
+
+		this->JobContext = (void*)&job;
+		this->JobInvoke = [](void* context, int task, int workerIndex) { (*static_cast<Callable*>(context))(task, workerIndex); };
+		this->Remaining = taskCount;
+
+		// Contiguous blocks per worker, idle workers steal from the front of the others
+		for (int task = 0; task < taskCount; task++)
+		{
+			WorkQueue& queue = *this->Queues[(long long)task * threadCount / taskCount];
+
+			std::lock_guard<std::mutex> lock(queue.Lock);
+			queue.Tasks.push_back(task);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(this->Lock);
+			this->Generation++;
+		}
+
+		this->WorkReady.notify_all();
+
+		Drain(0);
+
+		std::unique_lock<std::mutex> lock(this->Lock);
+		this->WorkDone.wait(lock, [this]() { return this->Remaining.load() == 0; });
+	}
+
+private:
+
+	// Owner pops from the back, thieves take from Head, the storage is kept for the next run once both meet
+	struct WorkQueue
+	{
+		std::mutex Lock;
+		std::vector<int> Tasks;
+		size_t Head = 0;
+
+		bool Empty()
+		{
+			return Head == Tasks.size();
+		}
+	};
+
+	std::vector<std::thread> Workers;
+
+	std::vector<std::unique_ptr<WorkQueue>> Queues;
+
+	void* JobContext = nullptr;
+
+	void (*JobInvoke)(void*, int, int) = nullptr;
+
+	std::mutex Lock;
+
+	std::condition_variable WorkReady;
+
+	std::condition_variable WorkDone;
+
+	std::atomic<int> Remaining;
+
+	long long Generation;
+
+	bool Stopping;
+
+	void WorkerLoop(int workerIndex)
+	{
+		long long seenGeneration = 0;
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(this->Lock);
+				this->WorkReady.wait(lock, [&]() { return this->Stopping || this->Generation != seenGeneration; });
+
+				if (this->Stopping)
+					return;
+
+				seenGeneration = this->Generation;
+			}
+
+			Drain(workerIndex);
+		}
+	}
+
+	void Drain(int workerIndex)
+	{
+		int task = 0;
+
+		while (PopTask(workerIndex, task))
+		{
+			this->JobInvoke(this->JobContext, task, workerIndex);
+
+			if (--this->Remaining == 0)
+			{
+				std::lock_guard<std::mutex> lock(this->Lock);
+				this->WorkDone.notify_all();
+			}
+		}
+	}
+
+	bool PopTask(int workerIndex, int& task)
+	{
+		int threadCount = GetThreadCount();
+
+		{
+			WorkQueue& own = *this->Queues[workerIndex];
+			std::lock_guard<std::mutex> lock(own.Lock);
+
+			if (!own.Empty())
+			{
+				task = own.Tasks.back();
+				own.Tasks.pop_back();
+
+				if (own.Empty())
+				{
+					own.Tasks.clear();
+					own.Head = 0;
+				}
+
+				return true;
+			}
+		}
+
+		for (int i = 1; i < threadCount; i++)
+		{
+			WorkQueue& victim = *this->Queues[(workerIndex + i) % threadCount];
+			std::lock_guard<std::mutex> lock(victim.Lock);
+
+			if (!victim.Empty())
+			{
+				task = victim.Tasks[victim.Head++];
+
+				if (victim.Empty())
+				{
+					victim.Tasks.clear();
+					victim.Head = 0;
+				}
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include "WavelengthGenerator.h"
+#include "RandomStream.h"
+class UniformWavelengthGenerator : public WavelengthGenerator
+{
+public:
+
+	double MinWavelength;
+
+	double MaxWavelength;
+
+	UniformWavelengthGenerator(double minWavelength, double maxWavelength)
+	{
+		MinWavelength = minWavelength;
+		MaxWavelength = maxWavelength;
+	}
+
+	double GenerateWavelength() override
+	{
+		return MinWavelength + (MaxWavelength - MinWavelength) * RandomStream::Current().Uniform();
+	}
+
+	// Hero wavelength sampling (Wilkie et al. 2014) : the others are the hero rotated by equal steps through the range
+	void GenerateWavelengths(double* wavelengths, int count) override
+	{
+		double u = RandomStream::Current().Uniform();
+
+		for (int k = 0; k < count; k++)
+		{
+			double rotated = u + (double)k / count;
+			rotated -= (int)rotated;
+
+			wavelengths[k] = MinWavelength + (MaxWavelength - MinWavelength) * rotated;
+		}
+	}
+};
\ No newline at end of file
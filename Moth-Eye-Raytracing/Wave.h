@@ -1,12 +1,12 @@
 #pragma once
 #include "Vec2.h"
-#include "Object.h"
+#include "HeightField.h"
 #include <functional>
-class Wave : public Object
+class Wave : public HeightField
 {
 public:
 
-	Wave(double x1, double y1, double x2, double y2, int resolution, std::function<double(double, double)> refractiveIndex, PerturbanceGenerator* generator, double A = 1.0, double B = 1.0, double C = 1.0, double D = 1.0) : Object()
+	Wave(double x1, double y1, double x2, double y2, int resolution, std::function<double(double, double)> refractiveIndex, PerturbanceGenerator* generator, double A = 1.0, double B = 1.0, double C = 1.0, double D = 1.0) : HeightField()
 	{
 		Type = "Wave";
 		std::vector<double> x = linspace(x1, x2, resolution);
@@ -18,10 +18,21 @@ public:
 			yShift[i] += A * sin(phase) + D;
 		}
 
+		int material = -1;
+		double materialIndex = 0.0;
+
+		// Neighbouring segments with the same index share a material
 		for (int i = 0; i < resolution - 1; i++)
 		{
 			double n = refractiveIndex(x[i], yShift[i]);
-			this->AddSegment(x[i], yShift[i], x[i + 1], yShift[i + 1], [n](double wavelength) {return n; }, generator);
+
+			if (material < 0 || n != materialIndex)
+			{
+				material = this->AddMaterial([n](double wavelength) {return n; }, generator);
+				materialIndex = n;
+			}
+
+			this->AddSegment(x[i], yShift[i], x[i + 1], yShift[i + 1], material);
 		}
 	}
 };
\ No newline at end of file
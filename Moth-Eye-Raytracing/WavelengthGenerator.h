@@ -11,4 +11,11 @@ public:
 	{
 		return 550.0;
 	}
+
+	// Wavelengths of a spectral bundle, independent draws unless a generator can stratify them
+	virtual void GenerateWavelengths(double* wavelengths, int count)
+	{
+		for (int k = 0; k < count; k++)
+			wavelengths[k] = GenerateWavelength();
+	}
 };
\ No newline at end of file
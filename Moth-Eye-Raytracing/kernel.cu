@@ -8,6 +8,7 @@
 #include "Mirror.h"
 #include "Target.h"
 #include "Wave.h"
+#include "LayerStack.h"
 #include <functional>
 #include "PointSource.h"
 #include "QuantumDot.h"
@@ -15,6 +16,7 @@
 #include "ConeLight.h"
 #include "FYDPSims.h"
 #include "NE451Sims.h"
+#include "Benchmarks.h"
 
 int main()
 {
@@ -23,6 +25,9 @@ int main()
 	//RunQDInternalReflection();
 	//RunRealLifeTests();
 	//RunWaveCalculations();
+	//RunBVHBenchmark();
+	//RunSpectrumBenchmark();
+	//return RunAllocationBenchmark(); // Needs #define COUNT_ALLOCATIONS above the includes
 
 	//GaussianDistribution gaus = GaussianDistribution(0, 5);
 	//